@@ -1,12 +1,24 @@
 #pragma once
+#include "bitboard.h"
+#include "protocol.h"
+#include "shm_transport.h"
+#include "tiled_grid.h"
 #include "utils.h"
 #include <SFML/Graphics.hpp>
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
 namespace cycles {
 
-using Id = sf::Uint8; ///< The type of the player's unique identifier
+/**
+ * @brief The largest number of players a game can hold
+ *
+ * Id 0 marks empty cells, so it is never assigned to a player. The id width
+ * is selected at build time with the CMake option CYCLES_WIDE_IDS, and the
+ * server and the clients must be built with the same one.
+ */
+constexpr int MAX_PLAYERS = std::numeric_limits<Id>::max();
 
 constexpr auto SERVER_IP = "127.0.0.1";
 
@@ -20,9 +32,6 @@ struct Player {
   Id id; ///< The unique identifier of the player
 };
 
-// Forward declaration for friend declaration in GameState
-class Connection;
-
 /**
  * @brief A representation of the state of the game
  */
@@ -31,20 +40,29 @@ struct GameState {
    * @brief The grid of the game
    *
    * Each cell is represented by the unique identifier of the player that
-   * occupies it. The value 0 represents an empty cell. The grid is stored in
-   * row-major order and has dimensions gridWidth x gridHeight.
+   * occupies it. The value 0 represents an empty cell. The grid has
+   * dimensions gridWidth x gridHeight and only stores the tiles with occupied
+   * cells, use getGridCell to read it.
    */
-  std::vector<Id> grid;
+  TiledGrid grid;
+
+  int gridWidth = 0;  ///< The width of the grid (in cells)
+  int gridHeight = 0; ///< The height of the grid (in cells)
 
-  int gridWidth;  ///< The width of the grid (in cells)
-  int gridHeight; ///< The height of the grid (in cells)
+  /**
+   * @brief The cells of the grid that are not empty, one bit per cell
+   *
+   * Built once when the state is received. Its complement (~occupied) is the
+   * set of free cells expected by floodFill, distanceLayers and voronoiCounts.
+   */
+  Bitboard occupied;
 
   /**
    * @brief A vector with the players in the game
    */
   std::vector<Player> players;
 
-  int frameNumber; ///< The number of the current frame
+  int frameNumber = 0; ///< The number of the current frame
 
   GameState() = default;
 
@@ -55,7 +73,7 @@ struct GameState {
    * @return Id The identifier of the player occupying the cell (0 if empty)
    */
   Id getGridCell(sf::Vector2i position) const {
-    return grid[position.y * gridWidth + position.x];
+    return grid.get(position.x, position.y);
   }
 
   /**
@@ -81,9 +99,24 @@ struct GameState {
            position.y < gridHeight;
   }
 
-private:
-  friend Connection;
-  GameState(sf::Packet &packet);
+  /**
+   * @brief Replace the whole state by the one in a keyframe
+   *
+   * Connection calls it for the frames it receives, it is only needed to
+   * read frames obtained some other way.
+   */
+  void applyKeyframe(const protocol::FrameView &frame);
+
+  /**
+   * @brief Apply the changes sent by the server since the previous frame
+   *
+   * @param scratch Swapped with the players, so that no memory is allocated
+   * from frame to frame
+   * @return false if the changes do not follow this state, which is then left
+   * unchanged or incomplete and must be replaced by a keyframe
+   */
+  bool applyDelta(const protocol::FrameView &frame,
+                  std::vector<Player> &scratch);
 };
 
 /**
@@ -95,15 +128,48 @@ class Connection {
   int frameNumber = 0;
   int lastFrameSent = -1;
   std::string playerName;
+  GameState state;         // Kept between frames, the server sends changes
+  bool needsKeyframe = true; // Until the first keyframe is received
+  sf::Packet packet;                   // Reused for every state received
+  std::vector<Player> previousPlayers; // Scratch space for the deltas
+  sf::SocketSelector selector;         // Waits for the server to send data
+  // Shared memory transport, when the server and the client both enable it
+  std::shared_ptr<shm::Segment> sharedMemory;
+  shm::FrameReader sharedFrames;
+  std::vector<char> frameBuffer; // Frame read from shared memory
+  std::uint32_t moveSlot = 0;
+  bool keyframeRequested = false; // Through shared memory
+  bool spectating = false;
+
+  // Applies a binary frame to the state. Returns false if it was ignored.
+  bool applyFrame(const void *data, std::size_t size);
+
+  // Applies the frames written in shared memory since the last call, stopping
+  // at the first one that updates the state unless all is set. Returns true if
+  // the state was updated.
+  bool receiveSharedFrames(bool all);
 
 public:
   /**
    * @brief Construct a new Connection object
    *
    * @param playerName The name of the player that is trying to connect
+   * @param compressGrid Ask the server to compress the grid of the full
+   * states it sends, which makes them much smaller on large grids
    * @return sf::Color The color assigned to the player
    */
-  sf::Color connect(std::string playerName);
+  sf::Color connect(std::string playerName, bool compressGrid = true);
+
+  /**
+   * @brief Connect to the server as a spectator, instead of connect
+   *
+   * Spectators connect to the port in the CYCLES_SPECTATOR_PORT environment
+   * variable. They receive the game states like players, but can not send
+   * moves and do not take part in the game.
+   *
+   * @param compressGrid See connect
+   */
+  void spectate(bool compressGrid = true);
 
   /**
    * @brief Send the player's move to the server
@@ -123,9 +189,35 @@ public:
    * Will block until the game state is received.
    * Can only be called once per frame.
    *
-   * @return GameState The game state
+   * The server only sends what changed since the previous frame, which is
+   * applied to a state kept by the connection.
+   *
+   * @return const GameState& The game state, valid until the next call
+   */
+  const GameState &receiveGameState();
+
+  /**
+   * @brief Receive the game states that have already arrived, without waiting
+   *
+   * Every state received is applied in order, so a bot that was busy for
+   * several frames catches up with the latest one. A state that is only
+   * partly received is kept until the next call.
+   *
+   * @return const GameState* The latest game state, valid until the next
+   * call, or nullptr if no state arrived since the last call
+   */
+  const GameState *tryReceiveGameState();
+
+  /**
+   * @brief Wait for a game state, up to a timeout
+   *
+   * Wakes up as soon as data arrives from the server, without polling.
+   *
+   * @param timeout The longest time to wait, must be more than zero
+   * @return const GameState* The latest game state (see tryReceiveGameState),
+   * or nullptr if none arrived in time
    */
-  GameState receiveGameState();
+  const GameState *waitForGameState(sf::Time timeout);
 
   /**
    * @brief Check if the connection is active
@@ -0,0 +1,142 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace cycles {
+
+/**
+ * @brief A set of cells of the grid, stored as one bit per cell
+ *
+ * Rows are packed into 64 bit words, so set operations and moving a whole set
+ * one cell in any direction process 64 cells at a time. This makes it cheap
+ * to run searches over the whole grid several times per frame.
+ */
+class Bitboard {
+  int width = 0;
+  int height = 0;
+  int wordsPerRow = 0;
+  std::vector<std::uint64_t> words;
+
+  std::uint64_t lastWordMask() const;
+
+public:
+  Bitboard() = default;
+
+  /**
+   * @brief Construct an empty set for a grid of the given size
+   */
+  Bitboard(int width, int height);
+
+  /**
+   * @brief Construct the set of cells of a grid that are not 0
+   *
+   * @param grid The grid, in row-major order
+   * @param width The width of the grid (in cells)
+   * @param height The height of the grid (in cells)
+   */
+  template <typename Cell>
+  Bitboard(const std::vector<Cell> &grid, int width, int height)
+      : Bitboard(width, height) {
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        if (grid[y * width + x] != 0) {
+          words[y * wordsPerRow + x / 64] |= std::uint64_t(1) << (x % 64);
+        }
+      }
+    }
+  }
+
+  int getWidth() const { return width; }
+
+  int getHeight() const { return height; }
+
+  /**
+   * @brief Check if a cell is in the set. Cells outside the grid never are.
+   */
+  bool contains(sf::Vector2i cell) const {
+    if (cell.x < 0 || cell.x >= width || cell.y < 0 || cell.y >= height) {
+      return false;
+    }
+    return (words[cell.y * wordsPerRow + cell.x / 64] >> (cell.x % 64)) & 1;
+  }
+
+  /**
+   * @brief Add or remove a cell, which must be inside the grid
+   */
+  void set(sf::Vector2i cell, bool value = true) {
+    auto &word = words[cell.y * wordsPerRow + cell.x / 64];
+    const auto mask = std::uint64_t(1) << (cell.x % 64);
+    word = value ? word | mask : word & ~mask;
+  }
+
+  /**
+   * @brief Number of cells in the set
+   */
+  int count() const;
+
+  /**
+   * @brief Check if the set has no cells
+   */
+  bool empty() const;
+
+  /**
+   * @brief The cells of the grid that are not in the set
+   */
+  Bitboard operator~() const;
+
+  Bitboard operator&(const Bitboard &other) const;
+  Bitboard operator|(const Bitboard &other) const;
+  Bitboard &operator&=(const Bitboard &other);
+  Bitboard &operator|=(const Bitboard &other);
+  bool operator==(const Bitboard &other) const = default;
+
+  /**
+   * @brief The set grown by one cell in the four directions
+   *
+   * Contains every cell of the set and every cell next to one of them, inside
+   * the grid.
+   */
+  Bitboard dilate() const;
+};
+
+/**
+ * @brief Find the free cells that can be reached from a position
+ *
+ * @param free The cells that can be walked through
+ * @param start The starting position, which does not need to be free (it is
+ * usually the position of a player)
+ * @return Bitboard The free cells connected to start, start itself is only
+ * included if it is free
+ */
+Bitboard floodFill(const Bitboard &free, sf::Vector2i start);
+
+/**
+ * @brief Breadth-first search from several cells at once
+ *
+ * @param free The cells that can be walked through
+ * @param sources The starting cells, they do not need to be free
+ * @param maxDistance Stop after this many layers (-1 for no limit)
+ * @return std::vector<Bitboard> Element d contains the free cells at distance
+ * d from the closest source (element 0 holds the sources). Ends with the last
+ * non empty layer.
+ */
+std::vector<Bitboard> distanceLayers(const Bitboard &free,
+                                     const Bitboard &sources,
+                                     int maxDistance = -1);
+
+/**
+ * @brief Count the cells each player can reach before any other player
+ *
+ * All players expand through the free cells at the same speed, cells reached
+ * at the same time by several players belong to none of them.
+ *
+ * @param free The cells that can be walked through
+ * @param positions The positions of the players
+ * @return std::vector<int> The number of cells owned by each player, in the
+ * same order as positions
+ */
+std::vector<int> voronoiCounts(const Bitboard &free,
+                               const std::vector<sf::Vector2i> &positions);
+
+} // namespace cycles
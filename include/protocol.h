@@ -0,0 +1,272 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+
+namespace cycles {
+
+/**
+ * @brief Values shared by the server and the clients to agree on the format
+ * of the packets they exchange
+ *
+ * The client sends its name followed by a byte of capability flags. Clients
+ * that do not send the flags get a full game state every frame, as before
+ * the flags existed.
+ *
+ * Clients with the deltaStates capability receive game states as binary
+ * frames (see FrameHeader): a keyframe when they join, and then the changes
+ * of every frame. A delta only applies to the state of the previous frame. A
+ * client that can not apply one appends a resync byte to its next move, and
+ * the server sends it a keyframe.
+ *
+ * The server answers the name with the color of the player and the size of
+ * the player ids. Clients that asked for shared memory (see shm_transport.h)
+ * also get the index of their move slot (Uint16) if the server has it enabled.
+ * A server that can not take the player answers with a color whose id size is
+ * rejected, and closes the connection.
+ */
+namespace protocol {
+
+static_assert(std::endian::native == std::endian::little,
+              "Binary frames are read and written in the host byte order, "
+              "which must be little endian");
+
+/**
+ * @brief Capability flags sent by the client after its name
+ */
+enum Capability : sf::Uint8 {
+  deltaStates = 1 << 0,    ///< The client can apply binary keyframes and deltas
+  compressedTiles = 1 << 1, ///< The client can read compressed keyframe tiles
+  taggedMoves = 1 << 2,     ///< The client tags its moves with their frame
+  sharedMemory = 1 << 3,    ///< The client can use the shared memory transport
+};
+
+/**
+ * @brief Id size of the color packet sent to a client that can not join
+ */
+constexpr sf::Uint8 rejected = 0;
+
+/**
+ * @brief Kind of a binary frame
+ */
+enum StateKind : std::uint8_t {
+  keyframe = 1, ///< The whole state
+  delta = 2,    ///< The changes since the previous frame
+};
+
+/**
+ * @brief Byte appended to a move to ask for a keyframe
+ *
+ * A move is the direction (as an Int32), optionally followed by this byte (0
+ * when no keyframe is needed). Clients with the taggedMoves capability always
+ * send the byte, followed by the number of the frame (Int32) whose state the
+ * move answers. The server discards moves for frames already played.
+ */
+constexpr sf::Uint8 resync = 1;
+
+/**
+ * @brief Flags of a binary frame
+ */
+enum FrameFlags : std::uint8_t {
+  /// The tiles of the keyframe are compressed with compressTile
+  tilesCompressed = 1 << 0,
+};
+
+constexpr char frameMagic[4] = {'C', 'Y', 'C', 'F'};
+constexpr std::uint8_t frameVersion = 1;
+
+/**
+ * @brief Fixed size header at the start of every binary frame
+ *
+ * The header is followed by sections whose size follows from it, back to
+ * back and without padding:
+ *   - playerCount PlayerRecord, in id order
+ *   - namesSize bytes with the names of the players
+ *   - keyframes: tileCount tile indices (uint32), then the cells of each of
+ *     those tiles, TiledGrid::tileSize squared ids of idBytes bytes each.
+ *     With the tilesCompressed flag the indices are followed instead by the
+ *     offset (uint32) of the end of each compressed tile, counting from the
+ *     first one, and then the compressed tiles.
+ *   - deltas: changeCount CellRecord
+ *
+ * All values are little endian, so both sides copy whole sections at once.
+ */
+struct FrameHeader {
+  char magic[4];
+  std::uint8_t version;
+  std::uint8_t idBytes; ///< Size of the ids in the grid section
+  std::uint8_t kind;    ///< A StateKind
+  std::uint8_t flags;   ///< FrameFlags
+  std::int32_t frame;
+  std::int32_t gridWidth;
+  std::int32_t gridHeight;
+  std::uint32_t playerCount;
+  std::uint32_t namesSize;
+  std::uint32_t tileCount;   ///< Allocated tiles, in keyframes
+  std::uint32_t changeCount; ///< Changed cells, in deltas
+};
+static_assert(sizeof(FrameHeader) == 36);
+
+/**
+ * @brief A player in a binary frame
+ *
+ * In deltas only the players that are new since the previous frame carry
+ * their name, the others have a nameLength of 0 and keep the one they had.
+ */
+struct PlayerRecord {
+  std::int32_t x;
+  std::int32_t y;
+  std::uint32_t nameOffset; ///< Offset of the name in the names section
+  std::uint16_t nameLength;
+  std::uint16_t id;
+  std::uint8_t r, g, b;
+  std::uint8_t isNew; ///< 1 if the name is included (always in keyframes)
+};
+static_assert(sizeof(PlayerRecord) == 20);
+
+/**
+ * @brief A cell set to a new value, in deltas
+ */
+struct CellRecord {
+  std::uint32_t cell; ///< Row-major index of the cell
+  std::uint16_t id;
+  std::uint16_t reserved;
+};
+static_assert(sizeof(CellRecord) == 8);
+
+/**
+ * @brief Read-only view of a binary frame, reading it in place
+ *
+ * Records are copied out one at a time, since the buffer has no alignment
+ * guarantees. The view does not own the buffer.
+ */
+class FrameView {
+  const char *data = nullptr;
+  std::size_t size = 0;
+  FrameHeader frameHeader{};
+  std::size_t playersOffset = 0;
+  std::size_t namesOffset = 0;
+  std::size_t sectionOffset = 0; // Tile indices or changed cells
+  std::size_t endsOffset = 0;    // Ends of the compressed tiles
+  std::size_t cellsOffset = 0;   // Cells of the tiles
+  std::size_t tileBytes = 0;
+  bool valid = false;
+
+  std::uint32_t readUint32(std::size_t offset) const {
+    std::uint32_t value;
+    std::memcpy(&value, data + offset, sizeof(value));
+    return value;
+  }
+
+public:
+  /**
+   * @brief Construct a view over a buffer holding a frame
+   *
+   * @param tileSize The size of the tiles of the grid (in cells)
+   */
+  FrameView(const void *buffer, std::size_t bufferSize, int tileSize)
+      : data(static_cast<const char *>(buffer)), size(bufferSize) {
+    if (size < sizeof(FrameHeader)) {
+      return;
+    }
+    std::memcpy(&frameHeader, data, sizeof(FrameHeader));
+    if (std::memcmp(frameHeader.magic, frameMagic, sizeof(frameMagic)) != 0 ||
+        frameHeader.version != frameVersion) {
+      return;
+    }
+    tileBytes = std::size_t(tileSize) * tileSize * frameHeader.idBytes;
+    playersOffset = sizeof(FrameHeader);
+    namesOffset =
+        playersOffset + std::size_t(frameHeader.playerCount) *
+                            sizeof(PlayerRecord);
+    sectionOffset = namesOffset + frameHeader.namesSize;
+    endsOffset = sectionOffset +
+                 std::size_t(frameHeader.tileCount) * sizeof(std::uint32_t);
+    cellsOffset = endsOffset;
+    auto cellsSize = std::size_t(frameHeader.tileCount) * tileBytes;
+    if (isCompressed()) {
+      cellsOffset +=
+          std::size_t(frameHeader.tileCount) * sizeof(std::uint32_t);
+      if (cellsOffset > size) {
+        return;
+      }
+      cellsSize = frameHeader.tileCount > 0
+                      ? readUint32(cellsOffset - sizeof(std::uint32_t))
+                      : 0;
+    }
+    const auto end = cellsOffset + cellsSize +
+                     std::size_t(frameHeader.changeCount) * sizeof(CellRecord);
+    valid = end == size;
+  }
+
+  /**
+   * @brief Check if the tiles are compressed (see compressTile)
+   */
+  bool isCompressed() const {
+    return frameHeader.flags & tilesCompressed;
+  }
+
+  /**
+   * @brief Check that the buffer holds a whole frame of a supported version
+   */
+  bool isValid() const { return valid; }
+
+  const FrameHeader &header() const { return frameHeader; }
+
+  PlayerRecord player(std::uint32_t i) const {
+    PlayerRecord record;
+    std::memcpy(&record, data + playersOffset + i * sizeof(PlayerRecord),
+                sizeof(record));
+    return record;
+  }
+
+  /**
+   * @brief The name of a player, empty if the record carries no name or it
+   * is out of the names section
+   */
+  std::string_view name(const PlayerRecord &record) const {
+    if (std::size_t(record.nameOffset) + record.nameLength >
+        frameHeader.namesSize) {
+      return {};
+    }
+    return std::string_view(data + namesOffset + record.nameOffset,
+                            record.nameLength);
+  }
+
+  std::uint32_t tileIndex(std::uint32_t i) const {
+    return readUint32(sectionOffset + i * sizeof(std::uint32_t));
+  }
+
+  /**
+   * @brief The cells of the i-th tile, raw in row-major order or compressed
+   *
+   * @return std::span<const char> The bytes of the tile, empty if the ends of
+   * the compressed tiles are out of order
+   */
+  std::span<const char> tileData(std::uint32_t i) const {
+    if (!isCompressed()) {
+      return {data + cellsOffset + i * tileBytes, tileBytes};
+    }
+    const auto begin =
+        i > 0 ? readUint32(endsOffset + (i - 1) * sizeof(std::uint32_t)) : 0;
+    const auto end = readUint32(endsOffset + i * sizeof(std::uint32_t));
+    if (begin > end || cellsOffset + end > size) {
+      return {};
+    }
+    return {data + cellsOffset + begin, end - begin};
+  }
+
+  CellRecord change(std::uint32_t i) const {
+    CellRecord record;
+    std::memcpy(&record, data + sectionOffset + i * sizeof(CellRecord),
+                sizeof(record));
+    return record;
+  }
+};
+
+} // namespace protocol
+
+} // namespace cycles
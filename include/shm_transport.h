@@ -0,0 +1,193 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cycles {
+
+/**
+ * @brief Transport of the game states through shared memory, for clients
+ * running on the same host as the server
+ *
+ * When the CYCLES_SHM environment variable is set (to a name such as
+ * /cycles), the server creates a shared memory segment with that name, and
+ * the clients started with the same variable ask to use it when they connect.
+ * The TCP connection is still used to join the game and to notice
+ * disconnections.
+ *
+ * The server writes every binary frame (see protocol::FrameHeader) once, in a
+ * ring shared by all the clients, which read it at their own pace. A client
+ * that falls so far behind that the server overwrites frames it did not read
+ * asks for a keyframe, as it does over TCP. Moves go back to the server through
+ * one slot per client.
+ *
+ * Only available on POSIX systems.
+ */
+namespace shm {
+
+constexpr auto environmentVariable = "CYCLES_SHM";
+constexpr char segmentMagic[4] = {'C', 'Y', 'C', 'S'};
+constexpr std::uint32_t segmentVersion = 1;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "Atomics in shared memory must be lock free");
+
+/**
+ * @brief The latest move of a client
+ *
+ * The client makes sequence odd while it writes the move and even again when
+ * it is done, the server only reads moves with an even sequence that did not
+ * change while it was reading them.
+ */
+struct MoveSlot {
+  std::atomic<std::uint32_t> sequence;
+  std::atomic<std::int32_t> frame; ///< The frame whose state the move answers
+  std::atomic<std::int32_t> direction;
+  /// Incremented by the client every time it needs a keyframe
+  std::atomic<std::uint32_t> keyframeRequests;
+};
+
+/**
+ * @brief Start of the segment, followed by the move slots and the ring
+ *
+ * Positions in the ring grow forever, the byte at position p is stored at
+ * p % ringSize. Frames are stored as a RecordHeader followed by the frame,
+ * padded to 8 bytes, and never wrap around the end of the ring.
+ */
+struct SegmentHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t idBytes;   ///< Size of the player ids of the server
+  std::uint32_t moveSlots; ///< Number of MoveSlot
+  std::uint64_t ringSize;  ///< Size of the ring (in bytes)
+  /// End of the bytes the server has started to write
+  std::atomic<std::uint64_t> reserved;
+  /// End of the frames that are completely written
+  std::atomic<std::uint64_t> published;
+  /// Incremented with every frame, clients wait for it to change
+  std::atomic<std::uint32_t> frameCount;
+};
+
+/**
+ * @brief Header of a frame in the ring
+ */
+struct RecordHeader {
+  std::uint32_t size;    ///< Size of the frame (in bytes)
+  std::uint32_t padding; ///< 1 if the rest of the ring is unused
+};
+
+/**
+ * @brief A move read from a MoveSlot
+ */
+struct Move {
+  int frame;
+  int direction;
+};
+
+/**
+ * @brief A shared memory segment mapped in this process
+ */
+class Segment {
+  std::string name;
+  void *memory = nullptr;
+  std::size_t size = 0;
+  bool owner = false;
+
+  Segment() = default;
+
+public:
+  /**
+   * @brief Create a segment, replacing any other with the same name. The
+   * segment is removed when the returned object is destroyed.
+   *
+   * @param name The name of the segment, starting with a /
+   * @param idBytes The size of the player ids
+   * @param moveSlots The number of clients that can use the segment at once
+   * @param ringSize The size of the ring of frames, a multiple of 8
+   * @throws std::runtime_error if the segment can not be created
+   */
+  static std::unique_ptr<Segment> create(const std::string &name,
+                                         std::uint32_t idBytes,
+                                         std::uint32_t moveSlots,
+                                         std::uint64_t ringSize);
+
+  /**
+   * @brief Map a segment created by the server
+   *
+   * @throws std::runtime_error if it does not exist or is not a segment of
+   * this version of the game
+   */
+  static std::unique_ptr<Segment> open(const std::string &name);
+
+  ~Segment();
+  Segment(const Segment &) = delete;
+  Segment &operator=(const Segment &) = delete;
+
+  SegmentHeader &header() { return *static_cast<SegmentHeader *>(memory); }
+
+  MoveSlot &moveSlot(std::uint32_t index);
+
+  char *ring();
+};
+
+/**
+ * @brief Append a frame to the ring, and wake up the clients waiting for it.
+ * Must only be called by the server.
+ *
+ * @throws std::runtime_error if the frame is larger than half the ring
+ */
+void writeFrame(Segment &segment, const void *data, std::size_t size);
+
+/**
+ * @brief Reads the frames of the ring in order, from the moment it is created
+ */
+class FrameReader {
+  Segment *segment = nullptr;
+  std::uint64_t position = 0;
+  std::uint32_t frameCount = 0;
+
+public:
+  enum Status {
+    empty, ///< No frame was written since the last one read
+    frame, ///< A frame was read
+    lost,  ///< Frames were overwritten before they were read
+  };
+
+  FrameReader() = default;
+  explicit FrameReader(Segment &segment);
+
+  /**
+   * @brief Read the next frame into buffer, if there is one
+   *
+   * After frames are lost, reading continues with the next frame written.
+   */
+  Status read(std::vector<char> &buffer);
+
+  /**
+   * @brief Wait until a frame is written after the last one read, or timeout
+   *
+   * @return true if a frame was written, false on timeout
+   */
+  bool wait(sf::Time timeout);
+};
+
+/**
+ * @brief Write the move of a client to its slot
+ */
+void writeMove(MoveSlot &slot, int frame, int direction);
+
+/**
+ * @brief Read the move in a slot, if it changed since lastSequence
+ *
+ * @param lastSequence The sequence of the last move read, updated
+ * @return true if a new move was read into move
+ */
+bool readMove(const MoveSlot &slot, std::uint32_t &lastSequence, Move &move);
+
+} // namespace shm
+
+} // namespace cycles
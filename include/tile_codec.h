@@ -0,0 +1,32 @@
+#pragma once
+#include "tiled_grid.h"
+#include <cstddef>
+#include <vector>
+
+namespace cycles {
+
+/**
+ * @brief Compress the cells of a tile
+ *
+ * Cells are run-length encoded in row-major order. Each run is stored as its
+ * length minus one, as a LEB128 varint, followed by the id of its cells.
+ * Empty rows are skipped using the occupancy bitmap of the tile, so the cost
+ * grows with the number of runs rather than with the number of cells.
+ *
+ * @param tile The tile to compress
+ * @param out The buffer the compressed tile is appended to
+ */
+void compressTile(const TiledGrid::Tile &tile, std::vector<char> &out);
+
+/**
+ * @brief Decompress a tile written by compressTile
+ *
+ * @param data The compressed tile
+ * @param size The size of the compressed tile (in bytes)
+ * @param cells The TiledGrid::tileSize squared cells to fill
+ * @return true if the data held exactly one tile
+ * @return false if it is malformed
+ */
+bool decompressTile(const char *data, std::size_t size, Id *cells);
+
+} // namespace cycles
@@ -0,0 +1,166 @@
+#pragma once
+#include <SFML/Network.hpp>
+#include <SFML/System.hpp>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cycles {
+
+#ifdef CYCLES_WIDE_IDS
+using Id = sf::Uint16; ///< The type of the player's unique identifier
+#else
+using Id = sf::Uint8; ///< The type of the player's unique identifier
+#endif
+
+/**
+ * @brief The cells of the grid, stored in square tiles that only exist where
+ * there is something
+ *
+ * The grid is split in tiles of tileSize x tileSize cells. A tile is allocated
+ * when one of its cells becomes occupied and released when it becomes empty
+ * again, so memory and the cost of visiting the occupied cells grow with the
+ * area covered by players rather than with the size of the grid. Each tile
+ * keeps a bitmap of its occupied cells, one 64 bit word per row.
+ */
+class TiledGrid {
+public:
+  static constexpr int tileSize = 64; ///< Width and height of a tile (in cells)
+
+  /**
+   * @brief A tile of the grid
+   */
+  struct Tile {
+    std::array<Id, tileSize * tileSize> cells{}; ///< Row-major cell values
+    std::array<std::uint64_t, tileSize> rows{};  ///< Bit x of row y is set if the cell is occupied
+    int occupied = 0; ///< Number of occupied cells
+  };
+
+private:
+  int width = 0;
+  int height = 0;
+  int tilesPerRow = 0;
+  std::vector<std::unique_ptr<Tile>> tiles; // nullptr for empty tiles
+  std::vector<std::unique_ptr<Tile>> spare; // Released tiles, kept for reuse
+  int tileCount = 0;
+
+  int tileIndex(int x, int y) const {
+    return (y / tileSize) * tilesPerRow + x / tileSize;
+  }
+
+  std::unique_ptr<Tile> newTile();
+  void releaseTile(int index);
+
+public:
+  TiledGrid() = default;
+
+  /**
+   * @brief Construct an empty grid of the given size (in cells)
+   */
+  TiledGrid(int width, int height);
+
+  TiledGrid(const TiledGrid &other);
+  TiledGrid &operator=(const TiledGrid &other);
+  TiledGrid(TiledGrid &&other) = default;
+  TiledGrid &operator=(TiledGrid &&other) = default;
+
+  int getWidth() const { return width; }
+
+  int getHeight() const { return height; }
+
+  /**
+   * @brief Number of tiles in a row of tiles
+   */
+  int getTilesPerRow() const { return tilesPerRow; }
+
+  /**
+   * @brief Get the value of a cell, which must be inside the grid
+   *
+   * @return Id The identifier of the player occupying the cell (0 if empty)
+   */
+  Id get(int x, int y) const {
+    const auto &tile = tiles[tileIndex(x, y)];
+    return tile ? tile->cells[(y % tileSize) * tileSize + x % tileSize] : 0;
+  }
+
+  /**
+   * @brief Set the value of a cell, which must be inside the grid
+   */
+  void set(int x, int y, Id id);
+
+  /**
+   * @brief Replace all the cells of a tile
+   *
+   * @param index The index of the tile, in row-major order of tiles
+   * @param cells tileSize x tileSize ids in row-major order, with no
+   * alignment requirement
+   */
+  void setTile(int index, const void *cells);
+
+  /**
+   * @brief Remove every player from the grid
+   */
+  void clear();
+
+  /**
+   * @brief The tile at an index, in row-major order of tiles
+   *
+   * @return const Tile* The tile, or nullptr if none of its cells is occupied
+   */
+  const Tile *getTile(int index) const { return tiles[index].get(); }
+
+  /**
+   * @brief Number of tiles holding at least one occupied cell
+   */
+  int getTileCount() const { return tileCount; }
+
+  /**
+   * @brief Call f(position, id) for every occupied cell
+   *
+   * Only the allocated tiles are visited, and in them only the occupied cells.
+   */
+  template <typename F> void forEachCell(F f) const {
+    forEachTile([&](sf::Vector2i origin, const Tile &tile) {
+      for (int y = 0; y < tileSize; ++y) {
+        for (auto bits = tile.rows[y]; bits; bits &= bits - 1) {
+          const int x = std::countr_zero(bits);
+          f(origin + sf::Vector2i(x, y), tile.cells[y * tileSize + x]);
+        }
+      }
+    });
+  }
+
+  /**
+   * @brief Call f(origin, tile) for every allocated tile, origin being the
+   * position of its top left cell
+   */
+  template <typename F> void forEachTile(F f) const {
+    for (int index = 0; index < static_cast<int>(tiles.size()); ++index) {
+      if (tiles[index]) {
+        f(sf::Vector2i(index % tilesPerRow, index / tilesPerRow) * tileSize,
+          *tiles[index]);
+      }
+    }
+  }
+
+  bool operator==(const TiledGrid &other) const;
+};
+
+/**
+ * @brief Write the occupied cells of a grid to a packet
+ *
+ * The layout is the number of allocated tiles, then for each of them its index
+ * and number of occupied cells followed by the position inside the tile and
+ * the value of each of them. Empty tiles are not written at all.
+ */
+sf::Packet &operator<<(sf::Packet &packet, const TiledGrid &grid);
+
+/**
+ * @brief Read the cells written by operator<< into a grid, which must have
+ * the size of the grid that was written
+ */
+sf::Packet &operator>>(sf::Packet &packet, TiledGrid &grid);
+
+} // namespace cycles
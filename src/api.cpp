@@ -1,40 +1,109 @@
 #include "api.h"
+#include "tile_codec.h"
 #include <SFML/Network.hpp>
 #include <spdlog/spdlog.h>
 
 namespace cycles {
 
-GameState::GameState(sf::Packet &packet) {
-  packet >> gridWidth >> gridHeight;
-  sf::Uint32 playerCount;
-  packet >> playerCount;
-  players.resize(playerCount);
-  for (sf::Uint32 i = 0; i < playerCount; ++i) {
-    int x, y;
-    sf::Uint8 r, g, b;
-    Id playerId;
-    std::string playerName;
-    packet >> x >> y >> r >> g >> b >> playerName >> playerId >> frameNumber;
-    players[i] = {playerName, sf::Color(r, g, b), sf::Vector2i(x, y), playerId};
-  }
-  grid.resize(gridWidth * gridHeight);
-  for (auto &cell : grid) {
-    packet >> cell;
-  }
-  //Check that the whole packet was read
-  if (!packet.endOfPacket()) {
-    spdlog::critical("There is still data left in the packet");
-    exit(1);
+void GameState::applyKeyframe(const protocol::FrameView &frame) {
+  const auto &header = frame.header();
+  frameNumber = header.frame;
+  if (header.gridWidth != gridWidth || header.gridHeight != gridHeight) {
+    gridWidth = header.gridWidth;
+    gridHeight = header.gridHeight;
+    grid = TiledGrid(gridWidth, gridHeight);
+  } else {
+    grid.clear();
+  }
+  occupied = Bitboard(gridWidth, gridHeight);
+  const int tileCount = (gridWidth + TiledGrid::tileSize - 1) /
+                        TiledGrid::tileSize *
+                        ((gridHeight + TiledGrid::tileSize - 1) /
+                         TiledGrid::tileSize);
+  std::array<Id, TiledGrid::tileSize * TiledGrid::tileSize> cells;
+  for (std::uint32_t i = 0; i < header.tileCount; ++i) {
+    const auto index = frame.tileIndex(i);
+    if (static_cast<int>(index) >= tileCount) {
+      spdlog::critical("Received a tile out of the grid");
+      exit(1);
+    }
+    const auto data = frame.tileData(i);
+    if (!frame.isCompressed()) {
+      grid.setTile(index, data.data());
+    } else if (decompressTile(data.data(), data.size(), cells.data())) {
+      grid.setTile(index, cells.data());
+    } else {
+      spdlog::critical("Received a malformed compressed tile");
+      exit(1);
+    }
+  }
+  grid.forEachCell([&](sf::Vector2i cell, Id) { occupied.set(cell); });
+  players.resize(header.playerCount);
+  for (std::uint32_t i = 0; i < header.playerCount; ++i) {
+    const auto record = frame.player(i);
+    auto &player = players[i];
+    player.id = record.id;
+    player.position = sf::Vector2i(record.x, record.y);
+    player.color = sf::Color(record.r, record.g, record.b);
+    player.name.assign(frame.name(record));
   }
 }
 
+bool GameState::applyDelta(const protocol::FrameView &frame,
+                           std::vector<Player> &scratch) {
+  const auto &header = frame.header();
+  if (header.frame != frameNumber + 1) {
+    spdlog::warn("Received the changes of frame {} on frame {}", header.frame,
+                 frameNumber);
+    return false;
+  }
+  frameNumber = header.frame;
+  // Players come in id order, names are only sent for new ones and the
+  // others are taken from the previous frame
+  std::swap(scratch, players);
+  players.resize(header.playerCount);
+  auto known = scratch.begin();
+  for (std::uint32_t i = 0; i < header.playerCount; ++i) {
+    const auto record = frame.player(i);
+    auto &player = players[i];
+    player.id = record.id;
+    player.position = sf::Vector2i(record.x, record.y);
+    player.color = sf::Color(record.r, record.g, record.b);
+    if (record.isNew) {
+      player.name.assign(frame.name(record));
+      continue;
+    }
+    while (known != scratch.end() && known->id < player.id) {
+      ++known;
+    }
+    if (known == scratch.end() || known->id != player.id) {
+      spdlog::warn("Received an unknown player {}", player.id);
+      return false;
+    }
+    std::swap(player.name, known->name);
+  }
+  for (std::uint32_t i = 0; i < header.changeCount; ++i) {
+    const auto change = frame.change(i);
+    const sf::Vector2i position(change.cell % gridWidth,
+                                change.cell / gridWidth);
+    if (!isInsideGrid(position)) {
+      spdlog::warn("Received a change out of the grid");
+      return false;
+    }
+    grid.set(position.x, position.y, change.id);
+    occupied.set(position, change.id != 0);
+  }
+  return true;
+}
+
 namespace detail {
-std::shared_ptr<sf::TcpSocket> establishLink() {
+std::shared_ptr<sf::TcpSocket>
+establishLink(const char *portVariable = "CYCLES_PORT") {
   spdlog::debug("Trying to connect");
   auto socket = std::make_shared<sf::TcpSocket>();
-  const char *port = std::getenv("CYCLES_PORT");
+  const char *port = std::getenv(portVariable);
   if (port == nullptr) {
-    spdlog::critical("Environment variable CYCLES_PORT not set");
+    spdlog::critical("Environment variable {} not set", portVariable);
     exit(1);
   }
   const unsigned short SERVER_PORT = std::stoi(port);
@@ -46,101 +115,273 @@ std::shared_ptr<sf::TcpSocket> establishLink() {
   return socket;
 }
 
-void sendPacket(std::shared_ptr<sf::TcpSocket> socket, sf::Packet &packet,
-                bool blocking = true) {
-  int attempts = 0;
-  bool blockingState = socket->isBlocking();
-  socket->setBlocking(blocking);
-  auto status = sf::Socket::NotReady;
-  while (status != sf::Socket::Done && attempts < 10) {
+// The socket stays in blocking mode, so the calls below return as soon as the
+// packet is out or in, without polling
+void sendPacket(std::shared_ptr<sf::TcpSocket> socket, sf::Packet &packet) {
+  auto status = socket->send(packet);
+  // The rest of a partially sent packet is sent by calling send again
+  while (status == sf::Socket::Partial) {
     status = socket->send(packet);
-    if (status == sf::Socket::NotReady) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-    attempts++;
   }
   if (status != sf::Socket::Done) {
     spdlog::critical("Failed to send packet to server");
     spdlog::critical("Reason: {}", socketErrorToString(status));
     exit(1);
   }
-  socket->setBlocking(blockingState);
 }
 
-sf::Packet receivePacket(std::shared_ptr<sf::TcpSocket> socket,
-                         bool blocking = true) {
-  sf::Packet packet;
-  bool blockingState = socket->isBlocking();
-  socket->setBlocking(blocking);
-  sf::Socket::Status status = sf::Socket::NotReady;
-  int attempts = 0;
-  while (status != sf::Socket::Done && attempts < 10) {
-    status = socket->receive(packet);
-    if (status == sf::Socket::NotReady) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
-    attempts++;
+void receivePacket(std::shared_ptr<sf::TcpSocket> socket, sf::Packet &packet) {
+  const auto status = socket->receive(packet);
+  if (status != sf::Socket::Done) {
+    spdlog::critical("Failed to receive packet from server");
+    spdlog::critical("Reason: {}", socketErrorToString(status));
+    exit(1);
+  }
+}
+
+// Reads a packet if a whole one has arrived. Part of a packet is kept by the
+// socket until the rest arrives.
+bool pollPacket(std::shared_ptr<sf::TcpSocket> socket, sf::Packet &packet) {
+  socket->setBlocking(false);
+  const auto status = socket->receive(packet);
+  socket->setBlocking(true);
+  if (status == sf::Socket::NotReady || status == sf::Socket::Partial) {
+    return false;
   }
   if (status != sf::Socket::Done) {
     spdlog::critical("Failed to receive packet from server");
     spdlog::critical("Reason: {}", socketErrorToString(status));
     exit(1);
   }
-  socket->setBlocking(blockingState);
-  return packet;
+  return true;
 }
 
-std::shared_ptr<sf::TcpSocket> connectToServer(std::string playerName) {
+std::shared_ptr<sf::TcpSocket> connectToServer(std::string playerName,
+                                               sf::Uint8 capabilities) {
   auto socket = detail::establishLink();
-  // Send name to server
+  // Send name to server, followed by what this client supports
   sf::Packet namePacket;
-  namePacket << playerName;
+  namePacket << playerName << capabilities;
   detail::sendPacket(socket, namePacket);
   return socket;
 }
 
 }; // namespace detail
 
-sf::Color Connection::connect(std::string playerName) {
+sf::Color Connection::connect(std::string playerName, bool compressGrid) {
   this->playerName = playerName;
   if (socket != nullptr) {
     spdlog::critical("Connection already established");
   }
-  socket = detail::connectToServer(playerName);
+  sf::Uint8 capabilities = protocol::deltaStates | protocol::taggedMoves;
+  if (compressGrid) {
+    capabilities |= protocol::compressedTiles;
+  }
+  // The reader is created before joining, so that no frame written for this
+  // client is missed
+  std::unique_ptr<shm::Segment> segment;
+  if (const char *name = std::getenv(shm::environmentVariable)) {
+    try {
+      segment = shm::Segment::open(name);
+      sharedFrames = shm::FrameReader(*segment);
+      capabilities |= protocol::sharedMemory;
+    } catch (const std::runtime_error &error) {
+      spdlog::warn("Not using shared memory: {}", error.what());
+    }
+  }
+  socket = detail::connectToServer(playerName, capabilities);
+  selector.clear();
+  selector.add(*socket);
   sf::Color color;
-  sf::Packet colorPacket = detail::receivePacket(socket);
+  sf::Packet colorPacket;
+  detail::receivePacket(socket, colorPacket);
   sf::Uint8 r, g, b;
   if (!(colorPacket >> r >> g >> b)) {
     spdlog::critical("Failed to receive color from server");
     exit(1);
   }
+  sf::Uint8 idSize;
+  if (colorPacket >> idSize && idSize == protocol::rejected) {
+    spdlog::critical("{}: The server rejected the player, the game is full "
+                     "or has started",
+                     playerName);
+    exit(1);
+  }
+  if (colorPacket && idSize != sizeof(Id)) {
+    spdlog::critical("Server uses {} byte player ids, but this client was "
+                     "built with {} byte ids (see CYCLES_WIDE_IDS)",
+                     idSize, sizeof(Id));
+    exit(1);
+  }
+  sf::Uint16 slot;
+  if (segment && colorPacket >> slot && slot < segment->header().moveSlots) {
+    sharedMemory = std::move(segment);
+    moveSlot = slot;
+    spdlog::info("{}: Receiving game states through shared memory",
+                 playerName);
+  }
   color = sf::Color(r, g, b);
   spdlog::info("{}: Assigned color: R={} G={} B={}", playerName,
                static_cast<int>(r), static_cast<int>(g), static_cast<int>(b));
   return color;
 }
 
+void Connection::spectate(bool compressGrid) {
+  if (socket != nullptr) {
+    spdlog::critical("Connection already established");
+  }
+  sf::Uint8 capabilities = protocol::deltaStates;
+  if (compressGrid) {
+    capabilities |= protocol::compressedTiles;
+  }
+  socket = detail::establishLink("CYCLES_SPECTATOR_PORT");
+  selector.clear();
+  selector.add(*socket);
+  sf::Packet packet;
+  packet << capabilities;
+  detail::sendPacket(socket, packet);
+  spectating = true;
+  spdlog::info("Watching the game");
+}
+
 void Connection::sendMove(Direction direction) {
+  if (spectating) {
+    spdlog::warn("Spectators can not send moves");
+    return;
+  }
   if (frameNumber == lastFrameSent) {
     spdlog::warn("Trying to send move twice in the same frame, call "
                  "receiveGameState first");
     return;
   }
   spdlog::debug("Sending move");
+  if (sharedMemory) {
+    auto &slot = sharedMemory->moveSlot(moveSlot);
+    if (needsKeyframe && !keyframeRequested) {
+      slot.keyframeRequests.fetch_add(1, std::memory_order_release);
+      keyframeRequested = true;
+    }
+    shm::writeMove(slot, frameNumber, getDirectionValue(direction));
+    lastFrameSent = frameNumber;
+    return;
+  }
   sf::Packet packet;
-  packet << getDirectionValue(direction);
+  const sf::Uint8 resync = needsKeyframe ? protocol::resync : 0;
+  packet << getDirectionValue(direction) << resync
+         << static_cast<sf::Int32>(frameNumber);
   detail::sendPacket(socket, packet);
   lastFrameSent = frameNumber;
 }
 
-GameState Connection::receiveGameState() {
+const GameState &Connection::receiveGameState() {
   spdlog::debug("Receiving game state");
-  auto packet = detail::receivePacket(socket);
-  GameState state(packet);
-  frameNumber = state.frameNumber;
+  if (!sharedMemory) {
+    detail::receivePacket(socket, packet);
+    applyFrame(packet.getData(), packet.getDataSize());
+    return state;
+  }
+  while (!receiveSharedFrames(false)) {
+    // Nothing is written any more once the server is gone
+    if (!sharedFrames.wait(sf::seconds(1)) && !isActive()) {
+      spdlog::critical("Lost the connection to the server");
+      exit(1);
+    }
+  }
   return state;
 }
 
+const GameState *Connection::tryReceiveGameState() {
+  bool received = false;
+  // Apply every state that arrived, deltas build on each other
+  if (sharedMemory) {
+    received = receiveSharedFrames(true);
+  }
+  while (!sharedMemory && detail::pollPacket(socket, packet)) {
+    received = applyFrame(packet.getData(), packet.getDataSize()) || received;
+  }
+  return received ? &state : nullptr;
+}
+
+bool Connection::receiveSharedFrames(bool all) {
+  bool updated = false;
+  while (true) {
+    switch (sharedFrames.read(frameBuffer)) {
+    case shm::FrameReader::empty:
+      return updated;
+    case shm::FrameReader::lost:
+      spdlog::warn("Game states were overwritten before they were read, "
+                   "asking for a keyframe");
+      needsKeyframe = true;
+      keyframeRequested = false;
+      break;
+    case shm::FrameReader::frame:
+      if (applyFrame(frameBuffer.data(), frameBuffer.size())) {
+        updated = true;
+        if (!all) {
+          return true;
+        }
+      }
+      break;
+    }
+  }
+}
+
+const GameState *Connection::waitForGameState(sf::Time timeout) {
+  sf::Clock clock;
+  while (true) {
+    if (const auto *received = tryReceiveGameState()) {
+      return received;
+    }
+    const auto remaining = timeout - clock.getElapsedTime();
+    if (remaining <= sf::Time::Zero) {
+      return nullptr;
+    }
+    // A selector wait of 0 would block until something arrives
+    const bool arrived = sharedMemory ? sharedFrames.wait(remaining)
+                                      : selector.wait(remaining);
+    if (!arrived) {
+      return nullptr;
+    }
+  }
+}
+
+bool Connection::applyFrame(const void *data, std::size_t size) {
+  const protocol::FrameView frame(data, size, TiledGrid::tileSize);
+  if (!frame.isValid() || frame.header().idBytes != sizeof(Id)) {
+    spdlog::critical("Received a game state this client can not read");
+    exit(1);
+  }
+  if (frame.header().kind == protocol::keyframe) {
+    // Through shared memory, clients that are in sync also see the keyframes
+    // written for the others
+    if (!needsKeyframe && frame.header().frame == state.frameNumber) {
+      return false;
+    }
+    state.applyKeyframe(frame);
+    needsKeyframe = false;
+    keyframeRequested = false;
+  } else if (frame.header().kind == protocol::delta) {
+    // Changes from before the first keyframe are of no use
+    if (needsKeyframe && state.gridWidth == 0) {
+      return false;
+    }
+    // Until the keyframe arrives changes can not be applied, and the state
+    // received last is returned again
+    if (!needsKeyframe && !state.applyDelta(frame, previousPlayers)) {
+      spdlog::warn("Game state out of sync, asking for a keyframe");
+      needsKeyframe = true;
+    }
+    if (needsKeyframe) {
+      state.frameNumber++;
+    }
+  } else {
+    spdlog::critical("Unknown game state kind {}", frame.header().kind);
+    exit(1);
+  }
+  frameNumber = state.frameNumber;
+  return true;
+}
+
 bool Connection::isActive() {
   return socket->getRemoteAddress() != sf::IpAddress::None;
 }
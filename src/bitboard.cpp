@@ -0,0 +1,174 @@
+#include "bitboard.h"
+#include <algorithm>
+#include <bit>
+
+namespace cycles {
+
+Bitboard::Bitboard(int width, int height)
+    : width(width), height(height), wordsPerRow((width + 63) / 64),
+      words(wordsPerRow * height, 0) {}
+
+// Bits of the last word of each row that are inside the grid
+std::uint64_t Bitboard::lastWordMask() const {
+  const int bits = width - (wordsPerRow - 1) * 64;
+  return bits == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << bits) - 1;
+}
+
+int Bitboard::count() const {
+  int total = 0;
+  for (auto word : words) {
+    total += std::popcount(word);
+  }
+  return total;
+}
+
+bool Bitboard::empty() const {
+  return std::all_of(words.begin(), words.end(),
+                     [](std::uint64_t word) { return word == 0; });
+}
+
+Bitboard Bitboard::operator~() const {
+  Bitboard result = *this;
+  const auto mask = lastWordMask();
+  for (int y = 0; y < height; ++y) {
+    for (int w = 0; w < wordsPerRow; ++w) {
+      auto &word = result.words[y * wordsPerRow + w];
+      word = ~word;
+      if (w == wordsPerRow - 1) {
+        word &= mask;
+      }
+    }
+  }
+  return result;
+}
+
+Bitboard &Bitboard::operator&=(const Bitboard &other) {
+  for (std::size_t i = 0; i < words.size(); ++i) {
+    words[i] &= other.words[i];
+  }
+  return *this;
+}
+
+Bitboard &Bitboard::operator|=(const Bitboard &other) {
+  for (std::size_t i = 0; i < words.size(); ++i) {
+    words[i] |= other.words[i];
+  }
+  return *this;
+}
+
+Bitboard Bitboard::operator&(const Bitboard &other) const {
+  Bitboard result = *this;
+  return result &= other;
+}
+
+Bitboard Bitboard::operator|(const Bitboard &other) const {
+  Bitboard result = *this;
+  return result |= other;
+}
+
+Bitboard Bitboard::dilate() const {
+  Bitboard result(width, height);
+  const auto mask = lastWordMask();
+  for (int y = 0; y < height; ++y) {
+    const auto *row = &words[y * wordsPerRow];
+    const auto *above = y > 0 ? row - wordsPerRow : nullptr;
+    const auto *below = y < height - 1 ? row + wordsPerRow : nullptr;
+    auto *out = &result.words[y * wordsPerRow];
+    for (int w = 0; w < wordsPerRow; ++w) {
+      // Bit x of a word is cell x, so shifting left moves cells east
+      const auto fromWest = (row[w] << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+      const auto fromEast =
+          (row[w] >> 1) | (w < wordsPerRow - 1 ? row[w + 1] << 63 : 0);
+      auto word = row[w] | fromWest | fromEast;
+      if (above) {
+        word |= above[w];
+      }
+      if (below) {
+        word |= below[w];
+      }
+      out[w] = w == wordsPerRow - 1 ? word & mask : word;
+    }
+  }
+  return result;
+}
+
+Bitboard floodFill(const Bitboard &free, sf::Vector2i start) {
+  Bitboard reached(free.getWidth(), free.getHeight());
+  if (start.x < 0 || start.x >= free.getWidth() || start.y < 0 ||
+      start.y >= free.getHeight()) {
+    return reached;
+  }
+  reached.set(start);
+  // The first step may leave an occupied start cell, the rest stay in free
+  reached = reached.dilate() & free;
+  while (true) {
+    auto grown = reached.dilate() & free;
+    if (grown == reached) {
+      break;
+    }
+    reached = std::move(grown);
+  }
+  return reached;
+}
+
+std::vector<Bitboard> distanceLayers(const Bitboard &free,
+                                     const Bitboard &sources,
+                                     int maxDistance) {
+  std::vector<Bitboard> layers{sources};
+  auto visited = sources;
+  for (int distance = 1; maxDistance < 0 || distance <= maxDistance;
+       ++distance) {
+    auto layer = layers.back().dilate() & free & ~visited;
+    if (layer.empty()) {
+      break;
+    }
+    visited |= layer;
+    layers.push_back(std::move(layer));
+  }
+  return layers;
+}
+
+std::vector<int> voronoiCounts(const Bitboard &free,
+                               const std::vector<sf::Vector2i> &positions) {
+  const auto players = positions.size();
+  std::vector<int> counts(players, 0);
+  std::vector<Bitboard> frontiers;
+  frontiers.reserve(players);
+  auto unclaimed = free;
+  for (const auto &position : positions) {
+    Bitboard frontier(free.getWidth(), free.getHeight());
+    if (position.x >= 0 && position.x < free.getWidth() && position.y >= 0 &&
+        position.y < free.getHeight()) {
+      frontier.set(position);
+    }
+    frontiers.push_back(std::move(frontier));
+  }
+  std::vector<Bitboard> grown(players);
+  // Cells reached by several players at once belong to none of them, and
+  // neither do the cells they are closest to, so they keep growing too
+  Bitboard contested(free.getWidth(), free.getHeight());
+  while (true) {
+    auto reachedTwice = contested.dilate() & unclaimed;
+    auto reachedOnce = reachedTwice;
+    bool anyGrowth = !reachedTwice.empty();
+    for (std::size_t i = 0; i < players; ++i) {
+      grown[i] = frontiers[i].dilate() & unclaimed;
+      reachedTwice |= reachedOnce & grown[i];
+      reachedOnce |= grown[i];
+      anyGrowth = anyGrowth || !grown[i].empty();
+    }
+    if (!anyGrowth) {
+      break;
+    }
+    const auto uncontested = ~reachedTwice;
+    for (std::size_t i = 0; i < players; ++i) {
+      frontiers[i] = grown[i] & uncontested;
+      counts[i] += frontiers[i].count();
+    }
+    contested = std::move(reachedTwice);
+    unclaimed &= ~reachedOnce;
+  }
+  return counts;
+}
+
+} // namespace cycles
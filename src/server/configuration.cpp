@@ -34,11 +34,35 @@ namespace cycles_server{
     if (config["enablePostProcessing"]) {
       enablePostProcessing = config["enablePostProcessing"].as<bool>();
     }
+    if (config["tickRate"]) {
+      tickRate = config["tickRate"].as<int>();
+    }
+    if (config["freeRunning"]) {
+      freeRunning = config["freeRunning"].as<bool>();
+    }
+    if (config["seed"]) {
+      seed = config["seed"].as<unsigned int>();
+    }
+    if (config["replayFile"]) {
+      replayFile = config["replayFile"].as<std::string>();
+    }
+    if (config["headless"]) {
+      headless = config["headless"].as<bool>();
+    }
+    if (config["startPlayers"]) {
+      startPlayers = config["startPlayers"].as<int>();
+    }
+    if (config["joinTimeout"]) {
+      joinTimeout = config["joinTimeout"].as<int>();
+    }
 
     std::set<std::string> knownParameters = {"maxClients", "gridWidth",
                                              "gridHeight", "gameWidth",
                                              "gameHeight", "gameBannerHeight",
-					     "enablePostProcessing"};
+					     "enablePostProcessing", "seed",
+					     "replayFile", "tickRate",
+					     "freeRunning", "headless",
+					     "startPlayers", "joinTimeout"};
     // Warn if there are unknown parameters
     for (const auto &it : config) {
       if (knownParameters.find(it.first.as<std::string>()) ==
@@ -47,6 +71,26 @@ namespace cycles_server{
                      it.first.as<std::string>());
       }
     }
+    if (maxClients > cycles::MAX_PLAYERS) {
+      spdlog::warn("maxClients ({}) is larger than the number of player ids "
+                   "available, limiting it to {}. Build with CYCLES_WIDE_IDS "
+                   "to allow more players.",
+                   maxClients, cycles::MAX_PLAYERS);
+      maxClients = cycles::MAX_PLAYERS;
+    }
+    if (tickRate <= 0) {
+      spdlog::warn("tickRate must be positive, using 30 frames per second");
+      tickRate = 30;
+    }
+    if (startPlayers < 0 || startPlayers > maxClients) {
+      spdlog::warn("startPlayers must be between 0 and maxClients, starting "
+                   "with maxClients players");
+      startPlayers = 0;
+    }
+    if (joinTimeout < 0) {
+      spdlog::warn("joinTimeout can not be negative, waiting forever");
+      joinTimeout = 0;
+    }
     cellSize = gameWidth / float(gridWidth);
   }
 
@@ -0,0 +1,59 @@
+#include "frame_exporter.h"
+#include "replay.h"
+#include <SFML/System.hpp>
+#include <filesystem>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+#include <string>
+
+using namespace cycles_server;
+
+// Exports every frame of a replay as an image, without opening a window
+int main(int argc, char *argv[]) {
+#if SPDLOG_ACTIVE_LEVEL == SPDLOG_LEVEL_TRACE
+  spdlog::set_level(spdlog::level::debug);
+#endif
+  if (argc < 3 || argc > 5) {
+    spdlog::error("Usage: {} replay_file output_directory [scale] [png|ppm]",
+                  argv[0]);
+    return 1;
+  }
+  const std::string replayPath = argv[1];
+  const std::filesystem::path outputDirectory = argv[2];
+  const std::string formatName = argc > 4 ? argv[4] : "png";
+  if (formatName != "png" && formatName != "ppm") {
+    spdlog::error("Unknown image format {}, use png or ppm", formatName);
+    return 1;
+  }
+  try {
+    const int scale = argc > 3 ? std::stoi(argv[3]) : 4;
+    ReplayPlayer player(replayPath);
+    const auto &conf = player.getConfiguration();
+    FrameExporter exporter(conf.gridWidth, conf.gridHeight, scale,
+                           formatName == "png" ? FrameExporter::png
+                                               : FrameExporter::ppm);
+    std::filesystem::create_directories(outputDirectory);
+    spdlog::info("Exporting {} frames of {}x{} pixels to {}",
+                 player.getFrameCount(), exporter.getWidth(),
+                 exporter.getHeight(), outputDirectory.string());
+    auto &game = player.getGame();
+    sf::Clock clock;
+    int frames = 0;
+    // The state before the moves of every frame, and the final one
+    do {
+      game.publishSnapshot();
+      const auto path =
+          outputDirectory / fmt::format("frame_{:06}.{}", player.getFrame(),
+                                        exporter.getExtension());
+      exporter.write(game.getSnapshot(), path.string());
+      frames++;
+    } while (player.step());
+    const float elapsed = clock.getElapsedTime().asSeconds();
+    spdlog::info("Exported {} frames in {:.3f} s ({:.0f} frames/s)", frames,
+                 elapsed, frames / elapsed);
+  } catch (const std::exception &error) {
+    spdlog::critical("{}", error.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,341 @@
+#include "frame_exporter.h"
+#include "game_logic.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+using namespace cycles_server;
+
+namespace {
+
+constexpr char pngSignature[8] = {'\x89', 'P',  'N',    'G',
+                                  '\r',   '\n', '\x1a', '\n'};
+constexpr std::uint32_t adlerModulo = 65521;
+
+// CRC-32 of the PNG chunks
+std::uint32_t crc32(const char *data, std::size_t size) {
+  static const auto table = [] {
+    std::array<std::uint32_t, 256> table;
+    for (std::uint32_t n = 0; n < 256; ++n) {
+      std::uint32_t c = n;
+      for (int k = 0; k < 8; ++k) {
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[n] = c;
+    }
+    return table;
+  }();
+  std::uint32_t crc = 0xFFFFFFFFu;
+  for (std::size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ static_cast<std::uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Checked before any member is sized from it
+int checkScale(int scale) {
+  if (scale < 1) {
+    throw std::runtime_error("The scale of the images must be at least 1");
+  }
+  return scale;
+}
+
+void appendUint32(std::vector<char> &out, std::uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>(value >> shift));
+  }
+}
+
+// Appends the header of a PNG chunk, its data must follow
+std::size_t beginChunk(std::vector<char> &out, const char *type) {
+  const auto start = out.size();
+  appendUint32(out, 0); // Length, set by endChunk
+  out.insert(out.end(), type, type + 4);
+  return start;
+}
+
+// Sets the length of the chunk started at start and appends its CRC
+void endChunk(std::vector<char> &out, std::size_t start) {
+  const auto size = out.size() - start - 8;
+  for (int i = 0; i < 4; ++i) {
+    out[start + i] = static_cast<char>(size >> (24 - 8 * i));
+  }
+  appendUint32(out, crc32(out.data() + start + 4, size + 4));
+}
+
+void appendChunk(std::vector<char> &out, const char *type,
+                 std::initializer_list<std::uint8_t> data) {
+  const auto start = beginChunk(out, type);
+  out.insert(out.end(), data.begin(), data.end());
+  endChunk(out, start);
+}
+
+// Writes a deflate block with the fixed Huffman codes. The only matches are
+// runs of the previous byte (distance 1), which is what filtered rows of
+// solid colors are made of.
+class DeflateWriter {
+  std::vector<char> &out;
+  std::uint32_t bits = 0;
+  int count = 0;
+
+  void put(std::uint32_t value, int length) {
+    bits |= value << count;
+    count += length;
+    while (count >= 8) {
+      out.push_back(static_cast<char>(bits));
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+
+  // Huffman codes are written from their most significant bit
+  void putCode(std::uint32_t code, int length) {
+    std::uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i) {
+      reversed |= ((code >> i) & 1) << (length - 1 - i);
+    }
+    put(reversed, length);
+  }
+
+  void putSymbol(int symbol) {
+    if (symbol < 144) {
+      putCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+      putCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+      putCode(symbol - 256, 7);
+    } else {
+      putCode(0xC0 + symbol - 280, 8);
+    }
+  }
+
+  void putRun(int length) {
+    static constexpr std::array<int, 29> base = {
+        3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static constexpr std::array<int, 29> extra = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    const int code =
+        std::upper_bound(base.begin(), base.end(), length) - base.begin() - 1;
+    putSymbol(257 + code);
+    put(length - base[code], extra[code]);
+    putCode(0, 5); // Distance 1
+  }
+
+public:
+  static constexpr int maxRun = 258;
+
+  // Starts a block that is not the last one of the stream
+  explicit DeflateWriter(std::vector<char> &out) : out(out) {
+    put(0, 1);
+    put(1, 2);
+  }
+
+  void write(const std::uint8_t *data, std::size_t size) {
+    std::size_t i = 0;
+    while (i < size) {
+      std::size_t run = 0;
+      if (i > 0) {
+        while (i + run < size && run < maxRun && data[i + run] == data[i - 1]) {
+          run++;
+        }
+      }
+      if (run >= 3) {
+        putRun(run);
+        i += run;
+      } else {
+        putSymbol(data[i]);
+        i++;
+      }
+    }
+  }
+
+  // Ends the block, followed by an empty stored block that aligns the stream
+  // to a byte so that the next band can start right after
+  void finish() {
+    putSymbol(256);
+    put(0, 3);
+    if (count > 0) {
+      put(0, 8 - count);
+    }
+    out.insert(out.end(), {'\0', '\0', '\xff', '\xff'});
+  }
+};
+
+} // namespace
+
+FrameExporter::FrameExporter(int gridWidth, int gridHeight, int scale,
+                             Format format, int threads)
+    : gridWidth(gridWidth), gridHeight(gridHeight), scale(checkScale(scale)),
+      width(gridWidth * scale), height(gridHeight * scale), format(format),
+      pixels(std::size_t(width) * height * 3) {
+  palette.resize(std::size_t(std::numeric_limits<Id>::max()) + 1);
+  palette[0] = sf::Color::Black;
+  for (std::size_t id = 1; id < palette.size(); ++id) {
+    palette[id] = Game::getPlayerColor(id);
+  }
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const int bandCount = std::min(threads, gridHeight);
+  for (int i = 0; i < bandCount; ++i) {
+    bands.push_back(Band{gridHeight * i / bandCount,
+                         gridHeight * (i + 1) / bandCount, {}, {}});
+  }
+}
+
+void FrameExporter::drawBand(const FrameSnapshot &snapshot, Band &band) {
+  const std::size_t rowBytes = std::size_t(width) * 3;
+  for (int y = band.begin; y < band.end; ++y) {
+    auto *row = pixels.data() + std::size_t(y) * scale * rowBytes;
+    auto *pixel = row;
+    for (int x = 0; x < gridWidth; ++x) {
+      const auto &color = palette[snapshot.grid.get(x, y)];
+      for (int i = 0; i < scale; ++i) {
+        *pixel++ = color.r;
+        *pixel++ = color.g;
+        *pixel++ = color.b;
+      }
+    }
+    for (int i = 1; i < scale; ++i) {
+      std::memcpy(row + i * rowBytes, row, rowBytes);
+    }
+  }
+  // Heads are a darker disk of the size of a cell with a border, clipped to
+  // the rows of the band
+  const float radius = scale;
+  const float outer = radius + std::max(1, scale / 3);
+  const int top = band.begin * scale;
+  const int bottom = band.end * scale;
+  for (const auto &player : snapshot.players) {
+    const float centerX = (player.position.x + 0.5f) * scale;
+    const float centerY = (player.position.y + 0.5f) * scale;
+    const int y0 = std::max(top, int(std::floor(centerY - outer)));
+    const int y1 = std::min(bottom, int(std::ceil(centerY + outer)));
+    const int x0 = std::max(0, int(std::floor(centerX - outer)));
+    const int x1 = std::min(width, int(std::ceil(centerX + outer)));
+    const sf::Color darker(player.color.r * 0.8, player.color.g * 0.8,
+                           player.color.b * 0.8);
+    for (int y = y0; y < y1; ++y) {
+      for (int x = x0; x < x1; ++x) {
+        const float dx = x + 0.5f - centerX;
+        const float dy = y + 0.5f - centerY;
+        const float distance = dx * dx + dy * dy;
+        if (distance > outer * outer) {
+          continue;
+        }
+        const auto &color = distance <= radius * radius ? darker : player.color;
+        auto *pixel = pixels.data() + (std::size_t(y) * width + x) * 3;
+        pixel[0] = color.r;
+        pixel[1] = color.g;
+        pixel[2] = color.b;
+      }
+    }
+  }
+}
+
+void FrameExporter::encodePngBand(Band &band) {
+  // Each row is filtered with Up when it repeats the previous one (cells are
+  // scale rows high) and with Sub otherwise, so that runs of the same color
+  // become runs of zeros
+  const std::size_t rowBytes = std::size_t(width) * 3;
+  band.rows.clear();
+  for (int y = band.begin * scale; y < band.end * scale; ++y) {
+    const auto *row = pixels.data() + y * rowBytes;
+    if (y > band.begin * scale &&
+        std::memcmp(row, row - rowBytes, rowBytes) == 0) {
+      band.rows.push_back(2);
+      band.rows.insert(band.rows.end(), rowBytes, 0);
+      continue;
+    }
+    band.rows.push_back(1);
+    band.rows.insert(band.rows.end(), row, row + 3);
+    for (std::size_t i = 3; i < rowBytes; ++i) {
+      band.rows.push_back(row[i] - row[i - 3]);
+    }
+  }
+  std::uint32_t a = 1;
+  std::uint32_t b = 0;
+  for (std::size_t i = 0; i < band.rows.size();) {
+    // The sums can not overflow within 5552 bytes
+    const auto end = std::min(band.rows.size(), i + 5552);
+    for (; i < end; ++i) {
+      a += band.rows[i];
+      b += a;
+    }
+    a %= adlerModulo;
+    b %= adlerModulo;
+  }
+  band.adlerA = a;
+  band.adlerB = b;
+  band.data.clear();
+  const auto chunk = beginChunk(band.data, "IDAT");
+  DeflateWriter deflate(band.data);
+  deflate.write(band.rows.data(), band.rows.size());
+  deflate.finish();
+  endChunk(band.data, chunk);
+}
+
+const std::vector<char> &FrameExporter::encode(const FrameSnapshot &snapshot) {
+  auto work = [&](Band &band) {
+    drawBand(snapshot, band);
+    if (format == png) {
+      encodePngBand(band);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < bands.size(); ++i) {
+    workers.emplace_back(work, std::ref(bands[i]));
+  }
+  work(bands.front());
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  image.clear();
+  if (format == ppm) {
+    const auto header = "P6\n" + std::to_string(width) + " " +
+                        std::to_string(height) + "\n255\n";
+    image.insert(image.end(), header.begin(), header.end());
+    image.insert(image.end(), pixels.begin(), pixels.end());
+    return image;
+  }
+  image.insert(image.end(), pngSignature, pngSignature + 8);
+  auto header = beginChunk(image, "IHDR");
+  appendUint32(image, width);
+  appendUint32(image, height);
+  // 8 bits per channel, RGB, deflate, standard filters, not interlaced
+  image.insert(image.end(), {8, 2, 0, 0, 0});
+  endChunk(image, header);
+  appendChunk(image, "IDAT", {0x78, 0x01}); // Zlib header
+  std::uint32_t a = 1;
+  std::uint32_t b = 0;
+  for (const auto &band : bands) {
+    image.insert(image.end(), band.data.begin(), band.data.end());
+    // Adler-32 of the concatenation of the rows of the bands
+    const std::uint64_t length = band.rows.size() % adlerModulo;
+    b = (b + band.adlerB + length * (a + adlerModulo - 1)) % adlerModulo;
+    a = (a + band.adlerA + adlerModulo - 1) % adlerModulo;
+  }
+  // A last empty stored block, and the Adler-32 ending the zlib stream
+  appendChunk(image, "IDAT",
+              {1, 0, 0, 0xff, 0xff, std::uint8_t(b >> 8), std::uint8_t(b),
+               std::uint8_t(a >> 8), std::uint8_t(a)});
+  appendChunk(image, "IEND", {});
+  return image;
+}
+
+void FrameExporter::write(const FrameSnapshot &snapshot,
+                          const std::string &path) {
+  const auto &data = encode(snapshot);
+  std::ofstream file(path, std::ios::binary);
+  file.write(data.data(), data.size());
+  if (!file) {
+    throw std::runtime_error("Failed to write " + path);
+  }
+}
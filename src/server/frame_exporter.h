@@ -0,0 +1,69 @@
+#pragma once
+#include "frame_snapshot.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cycles_server {
+
+// Draws frames into images on the CPU, without a window or an OpenGL context,
+// so that matches can be exported on machines without a display. Cells are
+// colored by looking up the color of their id, heads are drawn as in
+// GameRenderer but without the names.
+//
+// The rows of the image are split in bands, one per thread, that are drawn and
+// encoded in parallel. PNG bands are compressed independently (each with its
+// own deflate block, aligned to a byte) and written as consecutive IDAT
+// chunks, so no thread waits for another.
+class FrameExporter {
+public:
+  enum Format { ppm, png };
+
+private:
+  // A band of rows of the image, and its encoded bytes
+  struct Band {
+    int begin; // First row of cells
+    int end;
+    std::vector<char> data;
+    std::vector<std::uint8_t> rows; // Filtered rows (PNG only)
+    std::uint32_t adlerA = 1; // Adler-32 of the rows
+    std::uint32_t adlerB = 0;
+  };
+
+  int gridWidth;
+  int gridHeight;
+  int scale; // Pixels per cell
+  int width; // Of the image, in pixels
+  int height;
+  Format format;
+  std::vector<sf::Color> palette; // Color of every id
+  std::vector<std::uint8_t> pixels; // RGB, row-major
+  std::vector<Band> bands;
+  std::vector<char> image;
+
+  void drawBand(const FrameSnapshot &snapshot, Band &band);
+  // Filters and compresses the rows of a band into an IDAT chunk
+  void encodePngBand(Band &band);
+
+public:
+  // Images have scale x scale pixels per cell. Threads defaults to one per
+  // core.
+  FrameExporter(int gridWidth, int gridHeight, int scale, Format format,
+                int threads = 0);
+
+  // Draws a frame and returns its image, valid until the next call
+  const std::vector<char> &encode(const FrameSnapshot &snapshot);
+
+  // Draws a frame and writes its image to path, throws std::runtime_error if
+  // it can not be written
+  void write(const FrameSnapshot &snapshot, const std::string &path);
+
+  int getWidth() const { return width; }
+
+  int getHeight() const { return height; }
+
+  // Extension of the files, without the dot
+  const char *getExtension() const { return format == png ? "png" : "ppm"; }
+};
+
+} // namespace cycles_server
@@ -0,0 +1,72 @@
+#pragma once
+#include "server.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace cycles_server {
+
+// Read-only copy of the game at the end of a tick, handed to the renderer
+struct FrameSnapshot {
+  struct PlayerView {
+    Id id;
+    std::string name;
+    sf::Color color;
+    sf::Vector2i position;
+    std::size_t tailBegin;
+    std::size_t tailEnd;
+  };
+
+  std::uint64_t sequence = 0; // Increases with every published snapshot
+  int frame = 0;
+  bool gameOver = false;
+  cycles::TiledGrid grid;
+  // One per tile of grid in row-major order, changes whenever a cell of the
+  // tile does
+  std::vector<std::uint32_t> tileVersions;
+  std::vector<PlayerView> players; // In id order
+  std::vector<sf::Vector2i> tails; // Trails of all players, back to back
+
+  std::span<const sf::Vector2i> getTail(const PlayerView &player) const {
+    return std::span(tails).subspan(player.tailBegin,
+                                    player.tailEnd - player.tailBegin);
+  }
+};
+
+// Wait-free single producer, single consumer triple buffer of snapshots.
+// The producer fills the back slot and swaps it with the middle one, the
+// consumer swaps its front slot with the middle one when a new snapshot is
+// there. Neither side ever waits for the other and slots are reused, so after
+// the first few frames publishing does not allocate.
+class SnapshotBuffer {
+  static constexpr int freshBit = 4;
+  static constexpr int indexMask = 3;
+  std::array<FrameSnapshot, 3> slots;
+  std::atomic<int> middle = 1;
+  int back = 0;  // Owned by the producer
+  int front = 2; // Owned by the consumer
+  std::uint64_t published = 0;
+
+public:
+  // Slot to fill with the next snapshot, only valid until publish()
+  FrameSnapshot &beginWrite() { return slots[back]; }
+
+  void publish() {
+    slots[back].sequence = ++published;
+    back = middle.exchange(back | freshBit, std::memory_order_acq_rel) &
+           indexMask;
+  }
+
+  // Latest published snapshot, valid until the next call to read()
+  const FrameSnapshot &read() {
+    if (middle.load(std::memory_order_relaxed) & freshBit) {
+      front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+    }
+    return slots[front];
+  }
+};
+
+} // namespace cycles_server
@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace cycles_server {
+
+// Occupancy bitset of the grid with the number of free cells per block of
+// words, kept up to date as cells change. Allows to count the free cells and
+// to pick the n-th free one without scanning the grid.
+class FreeCells {
+  static constexpr int wordsPerBlock = 64;
+  int cellCount;
+  int freeCount;
+  std::vector<std::uint64_t> occupied; // One bit per cell
+  std::vector<int> blockFree;          // Free cells in each block of words
+
+  int freeInWord(int word) const {
+    const int bitsInWord = std::min(64, cellCount - word * 64);
+    return bitsInWord - std::popcount(occupied[word]);
+  }
+
+public:
+  FreeCells(int cellCount)
+      : cellCount(cellCount), freeCount(cellCount),
+        occupied((cellCount + 63) / 64, 0),
+        blockFree((occupied.size() + wordsPerBlock - 1) / wordsPerBlock, 0) {
+    for (int word = 0; word < static_cast<int>(occupied.size()); word++) {
+      blockFree[word / wordsPerBlock] += freeInWord(word);
+    }
+  }
+
+  void set(int cell, bool isOccupied) {
+    auto &word = occupied[cell / 64];
+    const std::uint64_t mask = std::uint64_t(1) << (cell % 64);
+    if (bool(word & mask) == isOccupied) {
+      return;
+    }
+    word ^= mask;
+    const int change = isOccupied ? -1 : 1;
+    blockFree[cell / 64 / wordsPerBlock] += change;
+    freeCount += change;
+  }
+
+  int getFreeCount() const { return freeCount; }
+
+  int getOccupiedCount() const { return cellCount - freeCount; }
+
+  // Index of the n-th free cell (counting from zero) in row-major order
+  int nthFree(int n) const {
+    int block = 0;
+    while (n >= blockFree[block]) {
+      n -= blockFree[block++];
+    }
+    int word = block * wordsPerBlock;
+    while (n >= freeInWord(word)) {
+      n -= freeInWord(word++);
+    }
+    std::uint64_t freeBits = ~occupied[word];
+    for (; n > 0; n--) {
+      freeBits &= freeBits - 1; // Drop the lowest free bit
+    }
+    return word * 64 + std::countr_zero(freeBits);
+  }
+
+  // A free cell chosen uniformly at random, or -1 if there are none
+  template <typename Rng> int sample(Rng &rng) const {
+    if (freeCount == 0) {
+      return -1;
+    }
+    std::uniform_int_distribution<int> dist(0, freeCount - 1);
+    return nthFree(dist(rng));
+  }
+};
+
+} // namespace cycles_server
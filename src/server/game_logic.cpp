@@ -1,23 +1,14 @@
 #include "game_logic.h"
+#include "replay.h"
+#include <algorithm>
 #include <map>
 #include <random>
-#include <set>
 #include <spdlog/spdlog.h>
 
 namespace cycles_server {
 
 namespace detail {
 
-template <typename T>
-std::map<Id, T> removeNonExistentPlayers(std::map<Id, T> directions,
-                                         const std::map<Id, Player> &players) {
-  for (auto [id, direction] : directions) {
-    if (players.find(id) == players.end()) {
-      directions.erase(id);
-    }
-  }
-  return directions;
-}
   std::tuple<int, int, int> hslToRgb(float h, float s, float l) {
     float c = (1 - std::abs(2 * l - 1)) * s;
     float x = c * (1 - std::abs(std::fmod(h / 60.0, 2) - 1));
@@ -71,80 +62,146 @@ sf::Color getRandomColor(auto rng) {
 
 } // namespace detail
 
+sf::Color Game::getPlayerColor(Id id) {
+  static const std::vector<uint32_t> palette =
+      detail::generateColorPalette(300);
+  return sf::Color(palette[id % palette.size()]);
+}
+
 Id Game::addPlayer(const std::string &name) {
-  static std::vector<uint32_t> palette = detail::generateColorPalette(300);
+  std::scoped_lock lock(gameMutex);
+  const int cell = freeCells.sample(rng);
+  if (cell < 0) {
+    spdlog::error("Game: No room left in the grid for player {}", name);
+    return 0;
+  }
+  if (recorder) {
+    recorder->recordJoin(name);
+  }
   gameStarted = true;
   Player newPlayer;
   newPlayer.name = name;
-  newPlayer.color = sf::Color(palette[idCounter]);
+  newPlayer.color = getPlayerColor(idCounter);
   newPlayer.id = idCounter;
-  std::uniform_real_distribution<float> dist(0, 1.0);
-  do {
-    newPlayer.position.x = conf.gridWidth * dist(rng);
-    newPlayer.position.y = conf.gridHeight * dist(rng);
-  } while (getCell(newPlayer.position.x, newPlayer.position.y));
-  getCell(newPlayer.position.x, newPlayer.position.y) = newPlayer.id;
-  players[idCounter] = newPlayer;
+  newPlayer.position.x = cell % conf.gridWidth;
+  newPlayer.position.y = cell / conf.gridWidth;
+  setCell(newPlayer.position.x, newPlayer.position.y, newPlayer.id);
+  players.insert(std::move(newPlayer));
   idCounter++;
   return idCounter - 1;
 }
 
 void Game::removePlayer(Id id) {
-  auto player_it = players.find(id);
-  if (player_it == players.end()) {
+  std::scoped_lock lock(gameMutex);
+  if (recorder && players.contains(id)) {
+    recorder->recordRemoval(id);
+  }
+  erasePlayer(id);
+}
+
+void Game::setRecorder(std::shared_ptr<ReplayRecorder> recorder) {
+  std::scoped_lock lock(gameMutex);
+  this->recorder = recorder;
+}
+
+void Game::restorePlayers(const std::vector<Player> &restored, Id nextId) {
+  std::scoped_lock lock(gameMutex);
+  for (auto id : std::vector<Id>(players.getIds())) {
+    erasePlayer(id);
+  }
+  for (const auto &player : restored) {
+    setCell(player.position.x, player.position.y, player.id);
+    for (auto tail : player.tail) {
+      setCell(tail.x, tail.y, player.id);
+    }
+    players.insert(player);
+  }
+  idCounter = nextId;
+  gameStarted = gameStarted || !restored.empty();
+}
+
+void Game::erasePlayer(Id id) {
+  const auto *player = players.find(id);
+  if (player == nullptr) {
     return;
   }
-  auto &player = player_it->second;
-  getCell(player.position.x, player.position.y) = 0;
-  for (auto tail : player.tail) {
-    getCell(tail.x, tail.y) = 0;
+  setCell(player->position.x, player->position.y, 0);
+  for (auto tail : player->tail) {
+    setCell(tail.x, tail.y, 0);
   }
   players.erase(id);
 }
 
-void Game::movePlayers(std::map<Id, Direction> directions) {
+void Game::movePlayers(const std::map<Id, Direction> &directions) {
+  std::scoped_lock lock(gameMutex);
+  if (recorder) {
+    recorder->recordMoves(frame, idCounter, players, directions);
+  }
   if (directions.size() == 0) {
     return;
   }
   max_tail_length = 55 + frame / 100;
-  // Sanitize directions
-  directions = detail::removeNonExistentPlayers(directions, players);
-  std::map<Id, sf::Vector2i> newPositions;
   // Transform directions to positions
+  moves.clear();
   for (const auto &[id, direction] : directions) {
-    auto it = players.find(id);
-    if (it == players.end()) {
+    // Directions for players that no longer exist are ignored
+    const auto *it = players.find(id);
+    if (it == nullptr) {
       continue;
     }
-    const auto &player = it->second;
+    const auto &player = *it;
     const sf::Vector2i newPos = player.position + getDirectionVector(direction);
     spdlog::debug(
         "Game: Player {} trying to move to ({},{}) from ({},{}) in frame {}",
         player.name, newPos.x, newPos.y, player.position.x, player.position.y,
         frame);
-    newPositions[id] = newPos;
+    moves.push_back({id, newPos, false});
   }
-  // Check for collisions
-  auto colliding = checkCollisions(newPositions);
-  for (auto id : colliding) {
-    removePlayer(id);
-    newPositions.erase(id);
+  checkCollisions();
+  for (const auto &move : moves) {
+    if (move.colliding) {
+      erasePlayer(move.id);
+    }
   }
   // Move remaining players
-  for (const auto &[id, newPos] : newPositions) {
-    auto it = players.find(id);
-    if (it == players.end()) {
+  for (const auto &move : moves) {
+    if (move.colliding) {
       continue;
     }
-    auto &player = it->second;
-    getCell(newPos.x, newPos.y) = player.id;
+    auto &player = players[move.id];
+    player.tail.reserve(max_tail_length + 1);
+    setCell(move.position.x, move.position.y, player.id);
     if (player.tail.size() > max_tail_length) {
-      getCell(player.tail.back().x, player.tail.back().y) = 0;
+      setCell(player.tail.back().x, player.tail.back().y, 0);
       player.tail.pop_back();
     }
     player.tail.push_front(player.position);
-    player.position = newPos;
+    player.position = move.position;
+  }
+}
+
+void Game::publishSnapshot() {
+  std::scoped_lock lock(gameMutex);
+  auto &snapshot = snapshots.beginWrite();
+  snapshot.frame = frame;
+  snapshot.gameOver = isGameOver();
+  snapshot.grid = grid;
+  snapshot.tileVersions = tileVersions;
+  snapshot.players.resize(players.size());
+  snapshot.tails.clear();
+  auto view = snapshot.players.begin();
+  for (const auto &player : players) {
+    view->id = player.id;
+    view->name = player.name;
+    view->color = player.color;
+    view->position = player.position;
+    view->tailBegin = snapshot.tails.size();
+    snapshot.tails.insert(snapshot.tails.end(), player.tail.begin(),
+                          player.tail.end());
+    view->tailEnd = snapshot.tails.size();
+    ++view;
   }
+  snapshots.publish();
 }
 
 bool Game::legalMove(sf::Vector2i newPos) {
@@ -161,33 +218,32 @@ bool Game::legalMove(sf::Vector2i newPos) {
   return true;
 }
 
-std::set<Id> Game::checkCollisions(std::map<Id, sf::Vector2i> newPositions) {
-  std::set<Id> colliding;
-  // If two players are trying to go to the same position, remove both
-  for (const auto &[id1, pos1] : newPositions) {
-    for (const auto &[id2, pos2] : newPositions) {
-      if (id1 < id2 && pos1 == pos2) {
-        spdlog::debug("Game: Players {} and {} collided", id1, id2);
-        colliding.insert(id1);
-        colliding.insert(id2);
-      }
+void Game::checkCollisions() {
+  claims.clear();
+  for (std::size_t i = 0; i < moves.size(); ++i) {
+    auto &move = moves[i];
+    // If a player is trying to go to a position where another player is, or
+    // out of the grid, remove the player
+    if (!legalMove(move.position)) {
+      spdlog::debug("Game: Player {} tried to move to an illegal position",
+                    move.id);
+      move.colliding = true;
+      continue;
     }
+    claims.emplace_back(move.position.y * conf.gridWidth + move.position.x,
+                        static_cast<std::uint32_t>(i));
   }
-  // If a player is trying to go to a position where another player is, remove
-  // the player
-  for (const auto &[id, newPos] : newPositions) {
-    auto player = players[id];
-    spdlog::debug(
-        "Game: Player {} trying to move to ({},{}) from ({},{}) in frame {}",
-        player.name, newPos.x, newPos.y, player.position.x, player.position.y,
-        frame);
-    if (!legalMove(newPos)) {
-      spdlog::debug("Game: Player {} tried to move to an illegal position",
-                    player.name);
-      colliding.insert(id);
+  // If two players are trying to go to the same position, remove both
+  std::sort(claims.begin(), claims.end());
+  for (std::size_t i = 1; i < claims.size(); ++i) {
+    if (claims[i].first == claims[i - 1].first) {
+      auto &first = moves[claims[i - 1].second];
+      auto &second = moves[claims[i].second];
+      spdlog::debug("Game: Players {} and {} collided", first.id, second.id);
+      first.colliding = true;
+      second.colliding = true;
     }
   }
-  return colliding;
 }
 
 } // namespace cycles_server
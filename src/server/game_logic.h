@@ -1,13 +1,25 @@
 #pragma once
+#include "frame_snapshot.h"
+#include "free_cells.h"
+#include "player_table.h"
 #include "server.h"
 #include <map>
+#include <memory>
 #include <mutex>
 #include <random>
-#include <set>
+#include <utility>
 #include <vector>
 
 namespace cycles_server {
 
+class ReplayRecorder;
+
+// A cell that was set to a new value, cell being its row-major index
+struct CellChange {
+  int cell;
+  Id id;
+};
+
 // Game Logic
 class Game {
   const Configuration conf;
@@ -15,28 +27,64 @@ class Game {
   Id idCounter = 1;
   int frame = 0;
   bool gameStarted = false;
-  std::map<Id, Player> players;
-  std::vector<sf::Uint8> grid;
+  PlayerTable players;
+  cycles::TiledGrid grid;
+  // Bumped whenever a cell of the tile changes, so readers of snapshots can
+  // tell which tiles changed without comparing their cells
+  std::vector<std::uint32_t> tileVersions;
+  FreeCells freeCells;
+  unsigned int seed;
   std::mt19937 rng;
   std::mutex gameMutex;
+  std::shared_ptr<ReplayRecorder> recorder;
+  SnapshotBuffer snapshots;
+  bool trackingChanges = false;
+  std::vector<CellChange> changes;
+
+  // Scratch space for movePlayers, reused every tick
+  struct Move {
+    Id id;
+    sf::Vector2i position;
+    bool colliding;
+  };
+  std::vector<Move> moves;
+  // Cell index and move of every legal move, sorted so that moves heading to
+  // the same cell are next to each other. Only holds the cells targeted this
+  // tick, so it does not grow with the size of the grid.
+  std::vector<std::pair<int, std::uint32_t>> claims;
 
 public:
   Game(Configuration conf)
-      : conf(conf), grid(conf.gridWidth * conf.gridHeight, 0),
-        rng(std::random_device()()) {}
+      : conf(conf), grid(conf.gridWidth, conf.gridHeight),
+        tileVersions(std::size_t(grid.getTilesPerRow()) *
+                     ((conf.gridHeight + cycles::TiledGrid::tileSize - 1) /
+                      cycles::TiledGrid::tileSize)),
+        freeCells(conf.gridWidth * conf.gridHeight),
+        seed(conf.seed ? conf.seed : std::random_device()()), rng(seed) {
+    publishSnapshot();
+  }
 
+  // Places a new player in a random empty cell and returns its id, or 0 if
+  // the grid is full
   Id addPlayer(const std::string &name);
 
   void removePlayer(Id id);
 
-  void movePlayers(std::map<Id, Direction> directions);
+  void movePlayers(const std::map<Id, Direction> &directions);
 
   const auto &getGrid() { return grid; }
 
-  auto getPlayers() {
-    std::scoped_lock lock(gameMutex);
-    return players;
-  }
+  // Borrowed view of the players, meant for the thread driving the game
+  const PlayerTable &getPlayers() const { return players; }
+
+  // Copies the current state into a snapshot that getSnapshot() will return
+  // from then on. Must be called from the thread driving the game.
+  void publishSnapshot();
+
+  // Latest published snapshot. Safe to call from a thread other than the one
+  // driving the game, but only one thread may read snapshots. The reference
+  // stays valid until the next call.
+  const FrameSnapshot &getSnapshot() { return snapshots.read(); }
 
   void setFrame(int frame) { this->frame = frame; }
 
@@ -44,13 +92,61 @@ public:
 
   bool isGameOver() { return gameStarted && players.size() <= 1; }
 
+  // Seed of the random generator, the same seed and the same sequence of
+  // joins, removals and moves always result in the same game
+  unsigned int getSeed() const { return seed; }
+
+  // From now on joins, removals and moves are written to recorder
+  void setRecorder(std::shared_ptr<ReplayRecorder> recorder);
+
+  // Replaces all the players by the given ones, used to restore a recorded
+  // state. The next player to join will get the id nextId.
+  void restorePlayers(const std::vector<Player> &restored, Id nextId);
+
+  Id getNextId() const { return idCounter; }
+
+  // From now on the cells changed are kept, in order, until taken with
+  // takeChanges
+  void trackChanges() { trackingChanges = true; }
+
+  // Moves the cells changed since the previous call into out
+  void takeChanges(std::vector<CellChange> &out) {
+    std::scoped_lock lock(gameMutex);
+    out.clear();
+    std::swap(out, changes);
+  }
+
+  int getOccupiedCells() const { return freeCells.getOccupiedCount(); }
+
+  // Fraction of the grid covered by players and their trails
+  float getFillRatio() const {
+    return freeCells.getOccupiedCount() /
+           float(conf.gridWidth * conf.gridHeight);
+  }
+
+  static sf::Color getPlayerColor(Id id);
+
 private:
 
-  Id &getCell(int x, int y) { return grid[y * conf.gridWidth + x]; }
+  void erasePlayer(Id id);
+
+  Id getCell(int x, int y) const { return grid.get(x, y); }
+
+  void setCell(int x, int y, Id id) {
+    const int cell = y * conf.gridWidth + x;
+    grid.set(x, y, id);
+    ++tileVersions[y / cycles::TiledGrid::tileSize * grid.getTilesPerRow() +
+                   x / cycles::TiledGrid::tileSize];
+    freeCells.set(cell, id != 0);
+    if (trackingChanges) {
+      changes.push_back({cell, id});
+    }
+  }
 
   bool legalMove(sf::Vector2i newPos);
 
-  std::set<Id> checkCollisions(std::map<Id, sf::Vector2i> newPositions);
+  // Marks the moves in moves that end in a collision, in a single pass
+  void checkCollisions();
 
 };
 
@@ -0,0 +1,120 @@
+#pragma once
+#include "tiled_grid.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <optional>
+
+namespace cycles_server {
+using cycles::Direction;
+using cycles::Id;
+
+// Moves received from a client, tagged with the frame whose state they answer.
+// Moves can arrive after their frame was played, those are stale and
+// discarded when the next frame is taken. At most maxSize moves are kept, the
+// oldest are dropped first.
+class InputQueue {
+  struct Move {
+    int frame;
+    Direction direction;
+  };
+  std::deque<Move> moves;
+  std::size_t maxSize;
+
+public:
+  explicit InputQueue(std::size_t maxSize = 8) : maxSize(maxSize) {}
+
+  std::size_t size() const { return moves.size(); }
+
+  void push(int frame, Direction direction) {
+    if (moves.size() >= maxSize) {
+      moves.pop_front();
+    }
+    moves.push_back({frame, direction});
+  }
+
+  // Returns the move for frame if it was received, after discarding the moves
+  // for earlier frames. Moves for later frames are kept.
+  std::optional<Direction> take(int frame) {
+    while (!moves.empty() && moves.front().frame < frame) {
+      moves.pop_front();
+    }
+    if (moves.empty() || moves.front().frame != frame) {
+      return std::nullopt;
+    }
+    const auto direction = moves.front().direction;
+    moves.pop_front();
+    return direction;
+  }
+};
+
+// Direction given to a player until its client sends one: towards the
+// farthest edge of the grid, so that it does not run into a wall at once
+inline Direction initialDirection(sf::Vector2i position, int gridWidth,
+                                  int gridHeight) {
+  const int north = position.y;
+  const int east = gridWidth - 1 - position.x;
+  const int south = gridHeight - 1 - position.y;
+  const int west = position.x;
+  const int farthest = std::max({north, east, south, west});
+  if (farthest == north) {
+    return Direction::north;
+  }
+  if (farthest == east) {
+    return Direction::east;
+  }
+  return farthest == south ? Direction::south : Direction::west;
+}
+
+// The direction of every player, kept until its client sends a new one, so
+// that players whose client is silent or late keep going instead of standing
+// still. Moves of clients that tag them are queued until their frame is
+// played.
+class PlayerInputs {
+  std::map<Id, Direction> directions;
+  std::map<Id, InputQueue> queues; // Clients that tag their moves
+
+public:
+  void add(Id id, Direction initial, bool tagged) {
+    directions[id] = initial;
+    if (tagged) {
+      queues.try_emplace(id);
+    }
+  }
+
+  void remove(Id id) {
+    directions.erase(id);
+    queues.erase(id);
+  }
+
+  bool isTagged(Id id) const { return queues.contains(id); }
+
+  // Records a move received for frame, or applies it at once if the client
+  // does not tag its moves (frame is -1)
+  void push(Id id, int frame, Direction direction) {
+    if (auto queue = queues.find(id); queue != queues.end() && frame >= 0) {
+      queue->second.push(frame, direction);
+    } else {
+      directions[id] = direction;
+    }
+  }
+
+  void set(Id id, Direction direction) { directions[id] = direction; }
+
+  Direction get(Id id) const { return directions.at(id); }
+
+  // The direction of every player for frame, once the queued moves that
+  // answer it are applied
+  const std::map<Id, Direction> &take(int frame) {
+    for (auto &[id, queue] : queues) {
+      if (auto direction = queue.take(frame)) {
+        directions[id] = *direction;
+      }
+    }
+    return directions;
+  }
+};
+
+} // namespace cycles_server
@@ -0,0 +1,119 @@
+#pragma once
+#include "server.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cycles_server {
+
+// Players stored in a flat vector indexed directly by their id.
+// Ids are small and handed out sequentially, so lookups are a single index
+// and the sorted list of live ids keeps iteration in id order, like the map
+// this replaces. Iterating yields the players themselves.
+class PlayerTable {
+  std::vector<Player> slots;
+  std::vector<bool> alive;
+  std::vector<Id> ids;
+
+  template <typename TablePtr, typename Value> class basic_iterator {
+    TablePtr table = nullptr;
+    std::vector<Id>::const_iterator it;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Player;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Value *;
+    using reference = Value &;
+
+    basic_iterator() = default;
+    basic_iterator(TablePtr table, std::vector<Id>::const_iterator it)
+        : table(table), it(it) {}
+
+    reference operator*() const { return table->slots[*it]; }
+    pointer operator->() const { return &table->slots[*it]; }
+    basic_iterator &operator++() {
+      ++it;
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      auto copy = *this;
+      ++it;
+      return copy;
+    }
+    bool operator==(const basic_iterator &other) const {
+      return it == other.it;
+    }
+  };
+
+public:
+  using iterator = basic_iterator<PlayerTable *, Player>;
+  using const_iterator = basic_iterator<const PlayerTable *, const Player>;
+
+  PlayerTable() {
+    slots.reserve(256);
+    alive.reserve(256);
+    ids.reserve(256);
+  }
+
+  Player &insert(Player player) {
+    const Id id = player.id;
+    if (id >= slots.size()) {
+      slots.resize(id + 1);
+      alive.resize(id + 1, false);
+    }
+    if (!alive[id]) {
+      alive[id] = true;
+      auto pos = std::lower_bound(ids.begin(), ids.end(), id);
+      ids.insert(pos, id);
+    }
+    slots[id] = std::move(player);
+    return slots[id];
+  }
+
+  void erase(Id id) {
+    if (!contains(id)) {
+      return;
+    }
+    alive[id] = false;
+    ids.erase(std::lower_bound(ids.begin(), ids.end(), id));
+    // Keep the tail storage around, only the contents are dropped
+    slots[id].tail.clear();
+  }
+
+  bool contains(Id id) const { return id < alive.size() && alive[id]; }
+
+  Player *find(Id id) { return contains(id) ? &slots[id] : nullptr; }
+
+  const Player *find(Id id) const {
+    return contains(id) ? &slots[id] : nullptr;
+  }
+
+  // Unchecked access, the player must be in the table
+  Player &operator[](Id id) { return slots[id]; }
+
+  const Player &operator[](Id id) const { return slots[id]; }
+
+  const Player &at(Id id) const {
+    if (!contains(id)) {
+      throw std::out_of_range("No player with id " + std::to_string(id));
+    }
+    return slots[id];
+  }
+
+  // Ids of the players in the table, in increasing order
+  const std::vector<Id> &getIds() const { return ids; }
+
+  std::size_t size() const { return ids.size(); }
+
+  bool empty() const { return ids.empty(); }
+
+  iterator begin() { return {this, ids.cbegin()}; }
+  iterator end() { return {this, ids.cend()}; }
+  const_iterator begin() const { return {this, ids.cbegin()}; }
+  const_iterator end() const { return {this, ids.cend()}; }
+};
+
+} // namespace cycles_server
@@ -1,6 +1,9 @@
 #include "renderer.h"
 #include "resources.h"
 #include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <map>
 #include <memory>
 #include <spdlog/spdlog.h>
@@ -8,6 +11,54 @@
 
 using namespace cycles_server;
 
+namespace {
+
+constexpr int headSegments = 16;
+
+// Unit circle, closed, for the heads
+const std::array<sf::Vector2f, headSegments + 1> &unitCircle() {
+  static const auto circle = [] {
+    std::array<sf::Vector2f, headSegments + 1> points;
+    for (int i = 0; i <= headSegments; ++i) {
+      const float angle = 2 * M_PI * i / headSegments;
+      points[i] = sf::Vector2f(std::cos(angle), std::sin(angle));
+    }
+    return points;
+  }();
+  return circle;
+}
+
+// Appends a disk of the given radius as triangles
+void appendDisk(sf::VertexArray &vertices, sf::Vector2f center, float radius,
+                sf::Color color) {
+  const auto &circle = unitCircle();
+  for (int i = 0; i < headSegments; ++i) {
+    vertices.append(sf::Vertex(center, color));
+    vertices.append(sf::Vertex(center + circle[i] * radius, color));
+    vertices.append(sf::Vertex(center + circle[i + 1] * radius, color));
+  }
+}
+
+// Appends a ring between two radii as triangles
+void appendRing(sf::VertexArray &vertices, sf::Vector2f center, float inner,
+                float outer, sf::Color color) {
+  const auto &circle = unitCircle();
+  for (int i = 0; i < headSegments; ++i) {
+    const sf::Vertex a(center + circle[i] * inner, color);
+    const sf::Vertex b(center + circle[i] * outer, color);
+    const sf::Vertex c(center + circle[i + 1] * inner, color);
+    const sf::Vertex d(center + circle[i + 1] * outer, color);
+    vertices.append(a);
+    vertices.append(b);
+    vertices.append(c);
+    vertices.append(c);
+    vertices.append(b);
+    vertices.append(d);
+  }
+}
+
+} // namespace
+
 void PostProcess::create(sf::Vector2i windowSize) {
   if (!sf::Shader::isAvailable()) {
     spdlog::critical("Shaders are not available in this system. Please run "
@@ -56,13 +107,97 @@ void PostProcess::apply(sf::RenderWindow &window, sf::RenderTexture &channel0) {
   window.draw(sf::Sprite(renderTexture.getTexture()), &bloomShader);
 }
 
+TextLayer::TextLayer(unsigned int characterSize, float outlineThickness)
+    : characterSize(characterSize), outlineThickness(outlineThickness),
+      vertices(sf::Triangles) {}
+
+TextLayer::Layout &TextLayer::getLayout(const std::string &string) {
+  auto [it, inserted] = layouts.try_emplace(string);
+  auto &layout = it->second;
+  layout.used = true;
+  if (!inserted || font == nullptr) {
+    return layout;
+  }
+  // Same layout as sf::Text: a single line with the baseline at
+  // characterSize, two triangles per glyph with a texel of padding
+  auto addQuad = [](std::vector<sf::Vertex> &quads, float x, float y,
+                    const sf::Glyph &glyph) {
+    const float padding = 1;
+    const float left = x + glyph.bounds.left - padding;
+    const float top = y + glyph.bounds.top - padding;
+    const float right = x + glyph.bounds.left + glyph.bounds.width + padding;
+    const float bottom = y + glyph.bounds.top + glyph.bounds.height + padding;
+    const float u1 = glyph.textureRect.left - padding;
+    const float v1 = glyph.textureRect.top - padding;
+    const float u2 =
+        glyph.textureRect.left + glyph.textureRect.width + padding;
+    const float v2 =
+        glyph.textureRect.top + glyph.textureRect.height + padding;
+    quads.emplace_back(sf::Vector2f(left, top), sf::Vector2f(u1, v1));
+    quads.emplace_back(sf::Vector2f(right, top), sf::Vector2f(u2, v1));
+    quads.emplace_back(sf::Vector2f(left, bottom), sf::Vector2f(u1, v2));
+    quads.emplace_back(sf::Vector2f(left, bottom), sf::Vector2f(u1, v2));
+    quads.emplace_back(sf::Vector2f(right, top), sf::Vector2f(u2, v1));
+    quads.emplace_back(sf::Vector2f(right, bottom), sf::Vector2f(u2, v2));
+  };
+  float x = 0;
+  const float y = characterSize;
+  sf::Uint32 previous = 0;
+  for (const unsigned char c : string) {
+    x += font->getKerning(previous, c, characterSize);
+    previous = c;
+    const auto &glyph = font->getGlyph(c, characterSize, false);
+    if (glyph.bounds.width > 0 && glyph.bounds.height > 0) {
+      if (outlineThickness > 0) {
+        addQuad(layout.outline, x, y,
+                font->getGlyph(c, characterSize, false, outlineThickness));
+      }
+      addQuad(layout.fill, x, y, glyph);
+    }
+    x += glyph.advance;
+  }
+  return layout;
+}
+
+void TextLayer::clear() {
+  vertices.clear();
+  for (auto it = layouts.begin(); it != layouts.end();) {
+    if (!it->second.used) {
+      it = layouts.erase(it);
+    } else {
+      it->second.used = false;
+      ++it;
+    }
+  }
+}
+
+void TextLayer::add(const std::string &string, sf::Vector2f position,
+                    sf::Color fillColor, sf::Color outlineColor) {
+  const auto &layout = getLayout(string);
+  // The outline and the fill of each label are kept together, so that labels
+  // overlap as they would with sf::Text
+  for (const auto *quads : {&layout.outline, &layout.fill}) {
+    const auto color = quads == &layout.fill ? fillColor : outlineColor;
+    for (const auto &vertex : *quads) {
+      vertices.append(
+          sf::Vertex(vertex.position + position, color, vertex.texCoords));
+    }
+  }
+}
+
+void TextLayer::draw(sf::RenderTarget &target) const {
+  if (font != nullptr && vertices.getVertexCount() > 0) {
+    target.draw(vertices, sf::RenderStates(&font->getTexture(characterSize)));
+  }
+}
+
 // Rendering Logic
 GameRenderer::GameRenderer(Configuration conf)
     : window(sf::VideoMode(conf.gameWidth,
                            conf.gameHeight + conf.gameBannerHeight),
              "Cycles++"),
-      conf(conf) {
-  window.setFramerateLimit(60);
+      conf(conf), nameLabels(30, 2) {
+  window.setFramerateLimit(framerate);
   try {
     auto fs = cycles_resources::getResourceFile("resources/SAIBA-45.ttf");
     font.loadFromMemory(fs.begin(), fs.size());
@@ -70,13 +205,54 @@ GameRenderer::GameRenderer(Configuration conf)
     spdlog::warn("No font loaded. Text rendering may not work correctly.");
   }
   renderTexture.create(window.getSize().x, window.getSize().y);
+  if (!boardTexture.create(conf.gridWidth, conf.gridHeight)) {
+    spdlog::critical("Failed to create a texture of {}x{} for the grid",
+                     conf.gridWidth, conf.gridHeight);
+    exit(1);
+  }
+  boardTexture.update(
+      std::vector<sf::Uint8>(std::size_t(conf.gridWidth) * conf.gridHeight * 4)
+          .data());
+  for (int level = 1; level <= lodLevels; ++level) {
+    const int width = (conf.gridWidth + (1 << level) - 1) >> level;
+    const int height = (conf.gridHeight + (1 << level) - 1) >> level;
+    auto &texture = boardLevels[level - 1];
+    texture.create(width, height);
+    texture.update(
+        std::vector<sf::Uint8>(std::size_t(width) * height * 4).data());
+  }
+  drawnVersions.assign(
+      std::size_t((conf.gridWidth + cycles::TiledGrid::tileSize - 1) /
+                  cycles::TiledGrid::tileSize) *
+          ((conf.gridHeight + cycles::TiledGrid::tileSize - 1) /
+           cycles::TiledGrid::tileSize),
+      0);
+  cameraCenter = sf::Vector2f(conf.gameWidth, conf.gameHeight) /
+                 conf.cellSize / 2.f;
+  heads.setPrimitiveType(sf::Triangles);
+  setupText();
   if (conf.enablePostProcessing) {
     postProcess = std::make_unique<PostProcess>();
     postProcess->create(sf::Vector2i(window.getSize().x, window.getSize().y));
   }
 }
 
+bool GameRenderer::isUpToDate(const FrameSnapshot &snapshot) {
+  if (snapshot.sequence == lastSequence && !cameraMoved) {
+    // Nothing changed since the last frame, wait as display() would have
+    sf::sleep(sf::seconds(1.0f / framerate));
+    return true;
+  }
+  lastSequence = snapshot.sequence;
+  cameraMoved = false;
+  return false;
+}
+
 void GameRenderer::render(std::shared_ptr<Game> game) {
+  const auto &snapshot = game->getSnapshot();
+  if (isUpToDate(snapshot)) {
+    return;
+  }
   window.clear(sf::Color::Black);
   // // Draw grid
   // sf::RectangleShape cell(sf::Vector2f(conf.cellSize - 1, conf.cellSize -
@@ -87,11 +263,11 @@ void GameRenderer::render(std::shared_ptr<Game> game) {
   // 	window.draw(cell);
   //   }
   // }
-  renderPlayers(game);
-  if (game->isGameOver()) {
-    renderGameOver(game);
+  renderPlayers(snapshot);
+  if (snapshot.gameOver) {
+    renderGameOver(snapshot);
   }
-  renderBanner(game);
+  renderBanner(snapshot);
   window.display();
 }
 
@@ -106,115 +282,385 @@ void GameRenderer::handleEvents(
         event.key.code == sf::Keyboard::Escape) {
       window.close();
     }
+    handleCameraEvent(event);
     for (auto &extraEvent : extraEventsHandlers) {
       extraEvent(event);
     }
   }
 }
 
-void GameRenderer::renderPlayers(std::shared_ptr<Game> game) {
-  const int offset_y = conf.gameBannerHeight + 0;
-  const int offset_x = 0;
-  auto cellSize = conf.cellSize;
+sf::View GameRenderer::getCamera() const {
+  const float windowHeight = conf.gameHeight + conf.gameBannerHeight;
+  sf::View camera(cameraCenter, sf::Vector2f(conf.gameWidth, conf.gameHeight) /
+                                    conf.cellSize * cameraZoom);
+  camera.setViewport(sf::FloatRect(0, conf.gameBannerHeight / windowHeight, 1,
+                                   conf.gameHeight / windowHeight));
+  return camera;
+}
+
+void GameRenderer::handleCameraEvent(const sf::Event &event) {
+  const float scale = conf.cellSize / cameraZoom; // Pixels per cell
+  // Cell under a position of the window
+  auto toCells = [&](int x, int y) {
+    return cameraCenter +
+           sf::Vector2f(x - conf.gameWidth / 2.f,
+                        y - conf.gameBannerHeight - conf.gameHeight / 2.f) /
+               scale;
+  };
+  auto pan = [&](sf::Vector2f offset) {
+    followedPlayer = 0;
+    cameraCenter += offset;
+    clampCamera();
+  };
+  const auto viewSize =
+      sf::Vector2f(conf.gameWidth, conf.gameHeight) / scale;
+  const auto previousCenter = cameraCenter;
+  const auto previousZoom = cameraZoom;
+  const auto previousFollowed = followedPlayer;
+  switch (event.type) {
+  case sf::Event::MouseWheelScrolled:
+    if (event.mouseWheelScroll.wheel == sf::Mouse::VerticalWheel) {
+      zoomCamera(std::pow(zoom_step, event.mouseWheelScroll.delta),
+                 toCells(event.mouseWheelScroll.x, event.mouseWheelScroll.y));
+    }
+    break;
+  case sf::Event::MouseButtonPressed:
+    if (event.mouseButton.button == sf::Mouse::Left) {
+      dragging = true;
+      dragPosition = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
+    }
+    break;
+  case sf::Event::MouseButtonReleased:
+    if (event.mouseButton.button == sf::Mouse::Left) {
+      dragging = false;
+    }
+    break;
+  case sf::Event::MouseMoved:
+    if (dragging) {
+      const sf::Vector2i position(event.mouseMove.x, event.mouseMove.y);
+      pan(sf::Vector2f(dragPosition - position) / scale);
+      dragPosition = position;
+    }
+    break;
+  case sf::Event::KeyPressed:
+    switch (event.key.code) {
+    case sf::Keyboard::Add:
+    case sf::Keyboard::Equal:
+      zoomCamera(zoom_step, cameraCenter);
+      break;
+    case sf::Keyboard::Subtract:
+    case sf::Keyboard::Hyphen:
+      zoomCamera(1 / zoom_step, cameraCenter);
+      break;
+    case sf::Keyboard::Left:
+      pan(sf::Vector2f(-viewSize.x * pan_step, 0));
+      break;
+    case sf::Keyboard::Right:
+      pan(sf::Vector2f(viewSize.x * pan_step, 0));
+      break;
+    case sf::Keyboard::Up:
+      pan(sf::Vector2f(0, -viewSize.y * pan_step));
+      break;
+    case sf::Keyboard::Down:
+      pan(sf::Vector2f(0, viewSize.y * pan_step));
+      break;
+    case sf::Keyboard::Tab:
+      followNextPlayer();
+      break;
+    case sf::Keyboard::Home:
+      followedPlayer = 0;
+      cameraZoom = 1;
+      clampCamera();
+      break;
+    default:
+      break;
+    }
+    break;
+  default:
+    break;
+  }
+  cameraMoved |= cameraCenter != previousCenter ||
+                 cameraZoom != previousZoom ||
+                 followedPlayer != previousFollowed;
+}
+
+void GameRenderer::zoomCamera(float factor, sf::Vector2f anchor) {
+  const float previous = cameraZoom;
+  cameraZoom *= factor;
+  clampCamera();
+  cameraCenter = anchor + (cameraCenter - anchor) * (cameraZoom / previous);
+  clampCamera();
+}
+
+void GameRenderer::clampCamera() {
+  const auto boardSize =
+      sf::Vector2f(conf.gameWidth, conf.gameHeight) / conf.cellSize;
+  const float minZoom = std::min(
+      1.f, min_visible_cells / std::min(boardSize.x, boardSize.y));
+  cameraZoom = std::clamp(cameraZoom, minZoom, 1.f);
+  const auto half = boardSize * cameraZoom / 2.f;
+  cameraCenter.x = std::clamp(cameraCenter.x, half.x, boardSize.x - half.x);
+  cameraCenter.y = std::clamp(cameraCenter.y, half.y, boardSize.y - half.y);
+}
+
+void GameRenderer::followNextPlayer() {
+  if (playerIds.empty()) {
+    return;
+  }
+  // Players are in id order, wrap around after the last one
+  auto next = std::upper_bound(playerIds.begin(), playerIds.end(),
+                               followedPlayer);
+  followedPlayer = next != playerIds.end() ? *next : playerIds.front();
+  cameraZoom = std::min(cameraZoom, follow_zoom);
+  clampCamera();
+  spdlog::info("Following player {}", followedPlayer);
+}
+
+void GameRenderer::updateBoard(const FrameSnapshot &snapshot,
+                               sf::IntRect tiles) {
+  constexpr int tileSize = cycles::TiledGrid::tileSize;
+  const auto &grid = snapshot.grid;
+  const int tilesPerRow = grid.getTilesPerRow();
+  tilePixels.resize(tileSize * tileSize * 4);
+  for (int ty = tiles.top; ty < tiles.top + tiles.height; ++ty) {
+    for (int tx = tiles.left; tx < tiles.left + tiles.width; ++tx) {
+      const int index = ty * tilesPerRow + tx;
+      if (snapshot.tileVersions[index] == drawnVersions[index]) {
+        continue;
+      }
+      const auto *tile = grid.getTile(index);
+      // Tiles on the right and bottom edges may stick out of the grid
+      const int left = tx * tileSize;
+      const int top = ty * tileSize;
+      const int width = std::min(tileSize, grid.getWidth() - left);
+      const int height = std::min(tileSize, grid.getHeight() - top);
+      blocks.resize(width * height);
+      auto *pixel = tilePixels.data();
+      auto *block = blocks.data();
+      for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+          const Id id = tile ? tile->cells[y * tileSize + x] : 0;
+          const auto color =
+              id != 0 ? Game::getPlayerColor(id) : sf::Color::Transparent;
+          *pixel++ = color.r;
+          *pixel++ = color.g;
+          *pixel++ = color.b;
+          *pixel++ = color.a;
+          *block++ = {id != 0, color.r, color.g, color.b};
+        }
+      }
+      boardTexture.update(tilePixels.data(), width, height, left, top);
+      updateLevels(left, top, width, height);
+      drawnVersions[index] = snapshot.tileVersions[index];
+    }
+  }
+}
+
+void GameRenderer::updateLevels(int left, int top, int width, int height) {
+  static_assert(1 << lodLevels == cycles::TiledGrid::tileSize,
+                "The last level has a texel per tile");
+  for (int level = 1; level <= lodLevels; ++level) {
+    // Each block of this level sums 2x2 blocks of the previous one
+    const int nextWidth = (width + 1) / 2;
+    const int nextHeight = (height + 1) / 2;
+    nextBlocks.assign(nextWidth * nextHeight, Block());
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        const auto &block = blocks[y * width + x];
+        auto &sum = nextBlocks[y / 2 * nextWidth + x / 2];
+        sum.count += block.count;
+        sum.r += block.r;
+        sum.g += block.g;
+        sum.b += block.b;
+      }
+    }
+    const int cells = 1 << (2 * level);
+    auto *pixel = tilePixels.data();
+    for (const auto &block : nextBlocks) {
+      if (block.count == 0) {
+        pixel = std::fill_n(pixel, 4, 0);
+        continue;
+      }
+      *pixel++ = block.r / block.count;
+      *pixel++ = block.g / block.count;
+      *pixel++ = block.b / block.count;
+      *pixel++ = 128 + 127 * block.count / cells;
+    }
+    boardLevels[level - 1].update(tilePixels.data(), nextWidth, nextHeight,
+                                  left >> level, top >> level);
+    std::swap(blocks, nextBlocks);
+    width = nextWidth;
+    height = nextHeight;
+  }
+}
+
+void GameRenderer::drawBoard(sf::IntRect visible, float scale) {
+  // The finest level with at most a texel per pixel
+  int level = 0;
+  while (level < lodLevels && scale * (2 << level) <= 1) {
+    level++;
+  }
+  const auto &texture = level == 0 ? boardTexture : boardLevels[level - 1];
+  const int left = visible.left >> level;
+  const int top = visible.top >> level;
+  const int right = (visible.left + visible.width + (1 << level) - 1) >> level;
+  const int bottom =
+      (visible.top + visible.height + (1 << level) - 1) >> level;
+  sf::Sprite board(texture, sf::IntRect(left, top, right - left, bottom - top));
+  board.setPosition(left << level, top << level);
+  board.setScale(1 << level, 1 << level);
+  renderTexture.draw(board);
+}
+
+void GameRenderer::renderPlayers(const FrameSnapshot &snapshot) {
+  playerIds.clear();
+  for (const auto &player : snapshot.players) {
+    playerIds.push_back(player.id);
+  }
+  if (followedPlayer != 0) {
+    auto followed = std::find(playerIds.begin(), playerIds.end(),
+                              followedPlayer);
+    if (followed == playerIds.end()) {
+      followedPlayer = 0; // It died
+    } else {
+      const auto &player = snapshot.players[followed - playerIds.begin()];
+      cameraCenter = sf::Vector2f(player.position) + sf::Vector2f(0.5f, 0.5f);
+      clampCamera();
+    }
+  }
+  const auto camera = getCamera();
+  const float scale = conf.cellSize / cameraZoom; // Pixels per cell
+  // Only the cells in view are drawn, with a cell of margin for the heads
+  const auto topLeft = camera.getCenter() - camera.getSize() / 2.f;
+  const int left = std::max(0, int(std::floor(topLeft.x)) - 1);
+  const int top = std::max(0, int(std::floor(topLeft.y)) - 1);
+  const int right = std::min(
+      conf.gridWidth, int(std::ceil(topLeft.x + camera.getSize().x)) + 1);
+  const int bottom = std::min(
+      conf.gridHeight, int(std::ceil(topLeft.y + camera.getSize().y)) + 1);
+  const sf::IntRect visible(left, top, std::max(0, right - left),
+                            std::max(0, bottom - top));
+
   auto windowSize = sf::Glsl::Vec2(window.getSize().x, window.getSize().y);
   renderTexture.clear(sf::Color::Black);
   sf::RectangleShape bkg(windowSize);
   bkg.setFillColor(sf::Color::Black);
   renderTexture.draw(bkg);
+  renderTexture.setView(camera);
 
-  for (const auto &[id, player] : game->getPlayers()) {
-    sf::CircleShape playerShape(cellSize);
-    // Make the head of the player darker
+  // The board is a single sprite and all the heads a single vertex array,
+  // however long the trails
+  if (visible.width > 0 && visible.height > 0) {
+    constexpr int tileSize = cycles::TiledGrid::tileSize;
+    const sf::IntRect tiles(left / tileSize, top / tileSize,
+                            (right - 1) / tileSize - left / tileSize + 1,
+                            (bottom - 1) / tileSize - top / tileSize + 1);
+    updateBoard(snapshot, tiles);
+    drawBoard(visible, scale);
+  }
+  heads.clear();
+  for (const auto &player : snapshot.players) {
+    if (!visible.contains(player.position)) {
+      continue;
+    }
+    const auto center =
+        sf::Vector2f(player.position) + sf::Vector2f(0.5f, 0.5f);
+    // Make the head of the player darker, with a border. The border keeps
+    // its width in pixels so that heads stay visible when zoomed out.
     auto darkerColor = player.color;
     darkerColor.r = darkerColor.r * 0.8;
     darkerColor.g = darkerColor.g * 0.8;
     darkerColor.b = darkerColor.b * 0.8;
-    playerShape.setFillColor(darkerColor);
-    playerShape.setPosition(
-        (player.position.x) * cellSize - cellSize / 2 + offset_x,
-        (player.position.y) * cellSize - cellSize / 2 + offset_y);
-    renderTexture.draw(playerShape);
-    // Add a border to the head
-    sf::CircleShape borderShape(cellSize + 1);
-    borderShape.setFillColor(sf::Color::Transparent);
-    borderShape.setOutlineThickness(3);
-    borderShape.setOutlineColor(player.color);
-    borderShape.setPosition(
-        (player.position.x) * cellSize - cellSize / 2 - 1 + offset_x,
-        (player.position.y) * cellSize - cellSize / 2 - 1 + offset_y);
-    renderTexture.draw(borderShape);
-    // Draw tail
-    for (auto tail : player.tail) {
-      sf::RectangleShape tailShape(sf::Vector2f(cellSize, cellSize));
-      tailShape.setFillColor(player.color);
-      tailShape.setPosition(tail.x * cellSize + offset_x,
-                            tail.y * cellSize + offset_y);
-      renderTexture.draw(tailShape);
-    }
+    appendDisk(heads, center, 1, darkerColor);
+    appendRing(heads, center, 1 + 1 / scale, 1 + 4 / scale, player.color);
   }
+  renderTexture.draw(heads);
+  renderTexture.setView(renderTexture.getDefaultView());
   renderTexture.display();
   if (postProcess)
     postProcess->apply(window, renderTexture);
   else
     window.draw(sf::Sprite(renderTexture.getTexture()));
-  for (const auto &[id, player] : game->getPlayers()) {
-    sf::Text nameText(player.name, font, 30);
-    nameText.setFillColor(sf::Color::White);
-    nameText.setOutlineThickness(2);
-    nameText.setOutlineColor(sf::Color::Black);
-    nameText.setPosition(player.position.x * cellSize - 20 + offset_x,
-                         player.position.y * cellSize - 20 + offset_y);
-    window.draw(nameText);
+  nameLabels.clear();
+  for (const auto &player : snapshot.players) {
+    if (!visible.contains(player.position)) {
+      continue;
+    }
+    const auto position = (sf::Vector2f(player.position) - topLeft) * scale;
+    nameLabels.add(player.name,
+                   position + sf::Vector2f(-20, conf.gameBannerHeight - 20),
+                   sf::Color::White, sf::Color::Black);
   }
+  nameLabels.draw(window);
 }
 
-void GameRenderer::renderGameOver(std::shared_ptr<Game> game) {
-  sf::Text gameOverText("Game Over", font, 60);
+void GameRenderer::setupText() {
+  nameLabels.setFont(font);
+  banner.setSize(sf::Vector2f(conf.gameWidth, conf.gameBannerHeight - 20));
+  banner.setFillColor(sf::Color::Black);
+  banner.setPosition(0, 0);
+  for (auto *text : {&frameText, &playersText}) {
+    text->setFont(font);
+    text->setCharacterSize(22);
+    text->setFillColor(sf::Color::White);
+  }
+  frameText.setPosition(10, 10);
+  playersText.setPosition(10, 40);
+  gameOverText.setFont(font);
+  gameOverText.setString("Game Over");
+  gameOverText.setCharacterSize(60);
   gameOverText.setOutlineThickness(3);
   gameOverText.setOutlineColor(sf::Color::White);
   gameOverText.setFillColor(sf::Color::Black);
   gameOverText.setPosition(conf.gameWidth / 2 - 150, conf.gameHeight / 2 - 30);
-  if (game->getPlayers().size() > 0) {
-    auto winner = game->getPlayers().begin()->second.name;
-    sf::Text winnerText("Winner: " + winner, font, 40);
-    winnerText.setFillColor(sf::Color::Black);
-    winnerText.setOutlineThickness(3);
-    winnerText.setOutlineColor(sf::Color::White);
-    winnerText.setPosition(conf.gameWidth / 2 - 150, conf.gameHeight / 2 + 30);
+  winnerText.setFont(font);
+  winnerText.setCharacterSize(40);
+  winnerText.setFillColor(sf::Color::Black);
+  winnerText.setOutlineThickness(3);
+  winnerText.setOutlineColor(sf::Color::White);
+  winnerText.setPosition(conf.gameWidth / 2 - 150, conf.gameHeight / 2 + 30);
+  splashText.setFont(font);
+  splashText.setString("Waiting for players\npress SPACE to start");
+  splashText.setCharacterSize(30);
+  splashText.setFillColor(sf::Color::Black);
+  splashText.setOutlineThickness(2);
+  splashText.setOutlineColor(sf::Color::White);
+  splashText.setPosition(conf.gameWidth / 2 - 150, conf.gameHeight / 2 - 30);
+}
+
+void GameRenderer::renderGameOver(const FrameSnapshot &snapshot) {
+  if (snapshot.players.size() > 0) {
+    // setString only lays the text out again if the winner changed
+    winnerText.setString("Winner: " + snapshot.players.front().name);
     window.draw(winnerText);
   }
   window.draw(gameOverText);
 }
 
-void GameRenderer::renderBanner(std::shared_ptr<Game> game) {
+void GameRenderer::renderBanner(const FrameSnapshot &snapshot) {
   // Draw a banner at the top
-  sf::RectangleShape banner(
-      sf::Vector2f(conf.gameWidth, conf.gameBannerHeight - 20));
-  banner.setFillColor(sf::Color::Black);
-  banner.setPosition(0, 0);
   window.draw(banner);
-  // Draw the frame number
-  sf::Text frameText("Frame: " + std::to_string(game->getFrame()), font, 22);
-  frameText.setPosition(10, 10);
-  frameText.setFillColor(sf::Color::White);
+  // Draw the frame number and the number of players
+  if (snapshot.frame != bannerFrame) {
+    bannerFrame = snapshot.frame;
+    frameText.setString("Frame: " + std::to_string(snapshot.frame));
+  }
+  if (static_cast<int>(snapshot.players.size()) != bannerPlayers) {
+    bannerPlayers = snapshot.players.size();
+    playersText.setString("Players: " + std::to_string(bannerPlayers));
+  }
   window.draw(frameText);
-  // Draw the number of players
-  sf::Text playersText("Players: " + std::to_string(game->getPlayers().size()),
-                       font, 22);
-  playersText.setPosition(10, 40);
-  playersText.setFillColor(sf::Color::White);
   window.draw(playersText);
 }
 
 void GameRenderer::renderSplashScreen(std::shared_ptr<Game> game) {
+  const auto &snapshot = game->getSnapshot();
+  if (isUpToDate(snapshot)) {
+    return;
+  }
   window.clear(sf::Color::Black);
-  renderPlayers(game);
-  renderBanner(game);
-  sf::Text splashText("Waiting for players\npress SPACE to start", font, 30);
-  splashText.setFillColor(sf::Color::Black);
-  splashText.setOutlineThickness(2);
-  splashText.setOutlineColor(sf::Color::White);
-  splashText.setPosition(conf.gameWidth / 2 - 150, conf.gameHeight / 2 - 30);
+  renderPlayers(snapshot);
+  renderBanner(snapshot);
   window.draw(splashText);
   window.display();
 }
@@ -2,7 +2,12 @@
 #include"server.h"
 #include "game_logic.h"
 #include <SFML/Graphics.hpp>
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 
 namespace cycles_server{
@@ -18,12 +23,89 @@ public:
   void apply(sf::RenderWindow &window, sf::RenderTexture &target);
 };
 
+// Labels drawn from cached glyph quads. A label is laid out the first time
+// its string is drawn and kept while it is drawn every frame, so moving it
+// only translates its quads. All the labels go to the target in a single
+// draw call.
+class TextLayer {
+  struct Layout {
+    std::vector<sf::Vertex> outline; // Drawn under the fill
+    std::vector<sf::Vertex> fill;
+    bool used = true; // Drawn since the last call to clear()
+  };
+  const sf::Font *font = nullptr;
+  unsigned int characterSize;
+  float outlineThickness;
+  std::unordered_map<std::string, Layout> layouts;
+  sf::VertexArray vertices;
+
+  Layout &getLayout(const std::string &string);
+
+public:
+  TextLayer(unsigned int characterSize, float outlineThickness);
+
+  void setFont(const sf::Font &font) {
+    this->font = &font;
+    layouts.clear();
+  }
+
+  // Starts a new frame, dropping the layouts not drawn in the previous one
+  void clear();
+
+  // Adds a label with its top left corner at position, like sf::Text
+  void add(const std::string &string, sf::Vector2f position,
+           sf::Color fillColor, sf::Color outlineColor);
+
+  void draw(sf::RenderTarget &target) const;
+};
+
 class GameRenderer {
   sf::RenderWindow window;
   sf::Font font;
   sf::RenderTexture renderTexture;
   const Configuration conf;
   std::unique_ptr<PostProcess> postProcess;
+  static constexpr unsigned int framerate = 60;
+  std::uint64_t lastSequence = 0;
+  // The trails, one texel per cell, and the same downsampled for zoomed out
+  // views: a texel of level L covers 2^L x 2^L cells, with the average color
+  // of the occupied ones, more opaque the more of them are occupied
+  static constexpr int lodLevels = 6; // Up to a texel per tile
+  sf::Texture boardTexture;
+  std::array<sf::Texture, lodLevels> boardLevels; // Levels 1 to lodLevels
+  // FrameSnapshot::tileVersions of the tiles currently in the textures. The
+  // renderer draws a single game, whose tiles all start empty at version 0
+  std::vector<std::uint32_t> drawnVersions;
+  struct Block {
+    int count = 0; // Occupied cells
+    int r = 0, g = 0, b = 0;
+  };
+  std::vector<Block> blocks, nextBlocks; // Scratch space for the levels
+  std::vector<sf::Uint8> tilePixels; // Scratch space to upload a tile
+  sf::VertexArray heads; // The heads of all the players, as triangles
+  // Text is kept between frames and only laid out again when it changes
+  TextLayer nameLabels;
+  sf::RectangleShape banner;
+  sf::Text frameText;
+  sf::Text playersText;
+  int bannerFrame = -1;
+  int bannerPlayers = -1;
+  sf::Text gameOverText;
+  sf::Text winnerText;
+  sf::Text splashText;
+  // Camera over the board, in cells. A zoom of 1 shows the whole board,
+  // smaller values zoom in.
+  sf::Vector2f cameraCenter;
+  float cameraZoom = 1;
+  Id followedPlayer = 0; // Kept at the center of the view, 0 for none
+  std::vector<Id> playerIds; // The players of the last frame drawn
+  bool dragging = false;
+  sf::Vector2i dragPosition; // Last position of the mouse while dragging
+  bool cameraMoved = false; // Draw again even if the game did not change
+  static constexpr float zoom_step = 0.8;        // Per key press or wheel step
+  static constexpr float pan_step = 0.1;         // Of the view, per key press
+  static constexpr float follow_zoom = 0.25;     // At most, when following
+  static constexpr float min_visible_cells = 16; // Across, when zoomed in
 
 public:
   GameRenderer(Configuration conf);
@@ -37,10 +119,38 @@ public:
   void renderSplashScreen(std::shared_ptr<Game> game);
 
 private:
-  void renderPlayers(std::shared_ptr<Game> game);
+  bool isUpToDate(const FrameSnapshot &snapshot);
+
+  // Uploads the tiles in the given range (in tiles) whose version changed
+  // since they were last uploaded
+  void updateBoard(const FrameSnapshot &snapshot, sf::IntRect tiles);
+
+  // Uploads a tile to the downsampled levels, from the blocks of level 0
+  void updateLevels(int left, int top, int width, int height);
+
+  // Draws the cells in visible with the level of detail for scale (pixels per
+  // cell)
+  void drawBoard(sf::IntRect visible, float scale);
+
+  sf::View getCamera() const;
+
+  void handleCameraEvent(const sf::Event &event);
+
+  // Multiplies the zoom by factor, keeping the anchor (in cells) in place
+  void zoomCamera(float factor, sf::Vector2f anchor);
+
+  // Keeps the zoom and the view within the board
+  void clampCamera();
+
+  void followNextPlayer();
+
+  void renderPlayers(const FrameSnapshot &snapshot);
+
+  // Sets up the text that does not depend on the game
+  void setupText();
 
-  void renderGameOver(std::shared_ptr<Game> game);
+  void renderGameOver(const FrameSnapshot &snapshot);
 
-  void renderBanner(std::shared_ptr<Game> game);
+  void renderBanner(const FrameSnapshot &snapshot);
 };
 }
@@ -0,0 +1,400 @@
+#include "replay.h"
+#include <algorithm>
+#include <iterator>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace cycles_server {
+
+namespace detail {
+
+void writeVarint(std::vector<char> &out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// Reads from a replay in memory, throws if it ends before expected
+class Reader {
+  const std::vector<char> &data;
+
+public:
+  std::size_t position;
+
+  Reader(const std::vector<char> &data, std::size_t position)
+      : data(data), position(position) {}
+
+  bool atEnd() const { return position >= data.size(); }
+
+  std::size_t remaining() const {
+    return atEnd() ? 0 : data.size() - position;
+  }
+
+  // Reads the number of items that follow, checked against max before
+  // anything is allocated for them
+  std::size_t count(std::size_t max) {
+    const auto value = varint();
+    if (value > max) {
+      throw std::runtime_error("Corrupted count in replay");
+    }
+    return value;
+  }
+
+  std::uint8_t byte() {
+    if (atEnd()) {
+      throw std::runtime_error("Replay ended unexpectedly");
+    }
+    return static_cast<std::uint8_t>(data[position++]);
+  }
+
+  std::uint64_t varint() {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      auto b = byte();
+      value |= std::uint64_t(b & 0x7F) << shift;
+      if (!(b & 0x80)) {
+        return value;
+      }
+    }
+    throw std::runtime_error("Malformed varint in replay");
+  }
+
+  std::string string(std::size_t length) {
+    if (position + length > data.size()) {
+      throw std::runtime_error("Replay ended unexpectedly");
+    }
+    std::string result(data.begin() + position,
+                       data.begin() + position + length);
+    position += length;
+    return result;
+  }
+
+  // Calls f with each of count values packed four per byte
+  void packed(std::size_t count, auto f) {
+    std::uint8_t bits = 0;
+    for (std::size_t i = 0; i < count; i++) {
+      if (i % 4 == 0) {
+        bits = byte();
+      }
+      f((bits >> (2 * (i % 4))) & 3);
+    }
+  }
+};
+
+// Packs values of two bits, four per byte
+class PackedWriter {
+  std::vector<char> &out;
+  std::uint8_t bits = 0;
+  int count = 0;
+
+public:
+  PackedWriter(std::vector<char> &out) : out(out) {}
+
+  void push(int value) {
+    bits |= value << (2 * count);
+    if (++count == 4) {
+      finish();
+    }
+  }
+
+  void finish() {
+    if (count > 0) {
+      out.push_back(static_cast<char>(bits));
+    }
+    bits = 0;
+    count = 0;
+  }
+};
+
+int stepDirection(sf::Vector2i from, sf::Vector2i to) {
+  auto step = to - from;
+  for (int d = 0; d < 4; d++) {
+    if (cycles::getDirectionVector(cycles::getDirectionFromValue(d)) == step) {
+      return d;
+    }
+  }
+  throw std::logic_error("Trail cells are not contiguous");
+}
+
+} // namespace detail
+
+ReplayRecorder::ReplayRecorder(const std::string &path,
+                               const Configuration &conf, unsigned int seed,
+                               int keyframeInterval)
+    : file(path, std::ios::binary), keyframeInterval(keyframeInterval) {
+  if (!file) {
+    spdlog::critical("Failed to open replay file {}", path);
+    exit(1);
+  }
+  spdlog::info("Recording replay to {} (seed {})", path, seed);
+  buffer.insert(buffer.end(), std::begin(replay::magic),
+                std::end(replay::magic));
+  detail::writeVarint(buffer, replay::version);
+  detail::writeVarint(buffer, sizeof(Id));
+  detail::writeVarint(buffer, seed);
+  detail::writeVarint(buffer, conf.gridWidth);
+  detail::writeVarint(buffer, conf.gridHeight);
+  detail::writeVarint(buffer, keyframeInterval);
+}
+
+ReplayRecorder::~ReplayRecorder() { flush(); }
+
+void ReplayRecorder::flush() {
+  file.write(buffer.data(), buffer.size());
+  file.flush();
+  buffer.clear();
+}
+
+void ReplayRecorder::recordJoin(const std::string &name) {
+  buffer.push_back(replay::join);
+  detail::writeVarint(buffer, name.size());
+  buffer.insert(buffer.end(), name.begin(), name.end());
+}
+
+void ReplayRecorder::recordRemoval(Id id) {
+  buffer.push_back(replay::removal);
+  detail::writeVarint(buffer, id);
+}
+
+void ReplayRecorder::recordMoves(int frame, Id nextId,
+                                 const PlayerTable &players,
+                                 const std::map<Id, Direction> &directions) {
+  if (frame >= nextKeyframe) {
+    std::vector<char> keyframe;
+    detail::writeVarint(keyframe, frame);
+    detail::writeVarint(keyframe, nextId);
+    detail::writeVarint(keyframe, players.size());
+    Id previousId = 0;
+    for (const auto &player : players) {
+      detail::writeVarint(keyframe, player.id - previousId);
+      previousId = player.id;
+      detail::writeVarint(keyframe, player.position.x);
+      detail::writeVarint(keyframe, player.position.y);
+      detail::writeVarint(keyframe, player.tail.size());
+      detail::PackedWriter steps(keyframe);
+      auto previous = player.position;
+      for (auto cell : player.tail) {
+        steps.push(detail::stepDirection(previous, cell));
+        previous = cell;
+      }
+      steps.finish();
+    }
+    buffer.push_back(replay::keyframe);
+    detail::writeVarint(buffer, keyframe.size());
+    buffer.insert(buffer.end(), keyframe.begin(), keyframe.end());
+    lastFrame = frame;
+    nextKeyframe = frame + keyframeInterval;
+  }
+  buffer.push_back(replay::moves);
+  detail::writeVarint(buffer, frame - lastFrame);
+  lastFrame = frame;
+  detail::writeVarint(buffer, directions.size());
+  Id previousId = 0;
+  for (const auto &[id, direction] : directions) {
+    detail::writeVarint(buffer, id - previousId);
+    previousId = id;
+  }
+  detail::PackedWriter packed(buffer);
+  for (const auto &[id, direction] : directions) {
+    packed.push(cycles::getDirectionValue(direction));
+  }
+  packed.finish();
+  if (buffer.size() > (1 << 20)) {
+    flush();
+  }
+}
+
+ReplayPlayer::ReplayPlayer(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Failed to open replay " + path);
+  }
+  data.assign(std::istreambuf_iterator<char>(file),
+              std::istreambuf_iterator<char>());
+  if (data.size() < sizeof(replay::magic) ||
+      !std::equal(std::begin(replay::magic), std::end(replay::magic),
+                  data.begin())) {
+    throw std::runtime_error(path + " is not a replay");
+  }
+  detail::Reader reader(data, sizeof(replay::magic));
+  if (reader.varint() != replay::version) {
+    throw std::runtime_error("Unsupported replay version in " + path);
+  }
+  if (reader.varint() != sizeof(Id)) {
+    throw std::runtime_error(path + " was recorded with a different id size");
+  }
+  conf.seed = reader.varint();
+  conf.gridWidth = reader.varint();
+  conf.gridHeight = reader.varint();
+  keyframeInterval = reader.varint();
+  recordsBegin = reader.position;
+  // Index the joins and keyframes
+  int currentFrame = 0;
+  lastFrame = -1;
+  while (!reader.atEnd()) {
+    const auto offset = reader.position;
+    switch (reader.byte()) {
+    case replay::join:
+      names.push_back(reader.string(reader.varint()));
+      lastJoinEnd = reader.position;
+      break;
+    case replay::removal:
+      reader.varint();
+      break;
+    case replay::keyframe: {
+      const auto length = reader.varint();
+      const auto begin = reader.position;
+      currentFrame = reader.varint();
+      keyframes.push_back({currentFrame, offset});
+      reader.position = begin + length;
+      break;
+    }
+    case replay::moves: {
+      currentFrame += reader.varint();
+      lastFrame = currentFrame;
+      const auto count = reader.varint();
+      for (std::size_t i = 0; i < count; i++) {
+        reader.varint();
+      }
+      reader.position += (count + 3) / 4;
+      break;
+    }
+    default:
+      throw std::runtime_error("Corrupted replay " + path);
+    }
+  }
+  spdlog::debug("Replay: {} players, {} frames, {} keyframes", names.size(),
+                lastFrame + 1, keyframes.size());
+  restart();
+}
+
+void ReplayPlayer::restart() {
+  game = std::make_unique<Game>(conf);
+  position = recordsBegin;
+  recordFrame = 0;
+  frame = 0;
+}
+
+void ReplayPlayer::restoreKeyframe(const Keyframe &keyframe) {
+  detail::Reader reader(data, keyframe.offset + 1);
+  const auto length = reader.varint();
+  const auto end = reader.position + length;
+  const int keyframeFrame = reader.varint();
+  const Id nextId = reader.varint();
+  // Each player takes at least a byte
+  std::vector<Player> restored(reader.count(std::min<std::size_t>(
+      cycles::MAX_PLAYERS, reader.remaining())));
+  Id id = 0;
+  for (auto &player : restored) {
+    id += reader.varint();
+    player.id = id;
+    player.name = names.at(id - 1);
+    player.color = Game::getPlayerColor(id);
+    player.position.x = reader.varint();
+    player.position.y = reader.varint();
+    // Steps are packed four per byte
+    std::vector<sf::Vector2i> cells(reader.count(4 * reader.remaining()));
+    auto previous = player.position;
+    auto cell = cells.begin();
+    reader.packed(cells.size(), [&](int step) {
+      previous += cycles::getDirectionVector(
+          cycles::getDirectionFromValue(step));
+      *cell++ = previous;
+    });
+    // The trail is stored from the newest cell to the oldest one
+    player.tail.reserve(cells.size());
+    for (auto it = cells.rbegin(); it != cells.rend(); ++it) {
+      player.tail.push_front(*it);
+    }
+  }
+  game->setFrame(keyframeFrame);
+  game->restorePlayers(restored, nextId);
+  position = end;
+  recordFrame = keyframeFrame;
+  frame = keyframeFrame;
+}
+
+int ReplayPlayer::peekMovesFrame() const {
+  if (position >= data.size() || data[position] != replay::moves) {
+    return -1;
+  }
+  detail::Reader reader(data, position + 1);
+  return recordFrame + reader.varint();
+}
+
+void ReplayPlayer::applyRecord() {
+  detail::Reader reader(data, position);
+  switch (reader.byte()) {
+  case replay::join:
+    game->addPlayer(reader.string(reader.varint()));
+    break;
+  case replay::removal:
+    game->removePlayer(reader.varint());
+    break;
+  case replay::keyframe: {
+    const auto length = reader.varint();
+    const auto begin = reader.position;
+    recordFrame = reader.varint();
+    reader.position = begin + length;
+    break;
+  }
+  case replay::moves: {
+    recordFrame += reader.varint();
+    directions.clear();
+    std::vector<Id> ids(reader.count(
+        std::min<std::size_t>(cycles::MAX_PLAYERS, reader.remaining())));
+    Id id = 0;
+    for (auto &moveId : ids) {
+      id += reader.varint();
+      moveId = id;
+    }
+    auto moveId = ids.begin();
+    reader.packed(ids.size(), [&](int direction) {
+      directions[*moveId++] = cycles::getDirectionFromValue(direction);
+    });
+    game->setFrame(recordFrame);
+    game->movePlayers(directions);
+    frame = recordFrame + 1;
+    break;
+  }
+  }
+  position = reader.position;
+}
+
+bool ReplayPlayer::step() {
+  while (position < data.size()) {
+    const bool isMoves = peekMovesFrame() >= 0;
+    applyRecord();
+    if (isMoves) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ReplayPlayer::seek(int targetFrame) {
+  // Keyframes can only be used after the last join, since restoring one does
+  // not restore the state of the random generator used to place new players
+  auto best = std::find_if(keyframes.rbegin(), keyframes.rend(),
+                           [&](const Keyframe &keyframe) {
+                             return keyframe.frame <= targetFrame &&
+                                    keyframe.offset >= lastJoinEnd;
+                           });
+  if (best != keyframes.rend() &&
+      (best->frame > frame || targetFrame < frame)) {
+    restoreKeyframe(*best);
+  } else if (targetFrame < frame) {
+    restart();
+  }
+  while (position < data.size()) {
+    const int movesFrame = peekMovesFrame();
+    if (movesFrame >= targetFrame) {
+      break;
+    }
+    applyRecord();
+  }
+}
+
+} // namespace cycles_server
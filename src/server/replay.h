@@ -0,0 +1,114 @@
+#pragma once
+#include "game_logic.h"
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cycles_server {
+
+// Replays store what is needed to re-simulate a match instead of its states:
+// the seed, the players joining and leaving, and the moves fed to
+// Game::movePlayers every frame. Every keyframeInterval frames the full state
+// of the players is stored too, so a replay can be seeked without simulating
+// it from the start.
+//
+// Layout, all integers are LEB128 varints:
+//   header:   "CYCR" version idBytes seed gridWidth gridHeight keyframeInterval
+//   join:     1 nameLength name
+//   removal:  2 id
+//   keyframe: 3 byteLength frame nextId playerCount
+//             {idDelta x y tailLength tailSteps}...
+//   moves:    4 frameDelta moveCount {idDelta}... directions
+// Ids are stored as the difference with the previous id in the record, frames
+// as the difference with the previous keyframe or moves record. Directions
+// and tail steps (the direction from a cell to the next one in the trail) are
+// packed four per byte.
+namespace replay {
+constexpr char magic[4] = {'C', 'Y', 'C', 'R'};
+constexpr int version = 1;
+enum Record : std::uint8_t { join = 1, removal = 2, keyframe = 3, moves = 4 };
+} // namespace replay
+
+// Writes a replay while a game is being played, see Game::setRecorder
+class ReplayRecorder {
+  std::ofstream file;
+  std::vector<char> buffer;
+  int keyframeInterval;
+  int lastFrame = 0;
+  int nextKeyframe = 0;
+
+  void flush();
+
+public:
+  ReplayRecorder(const std::string &path, const Configuration &conf,
+                 unsigned int seed, int keyframeInterval = 500);
+
+  ~ReplayRecorder();
+
+  void recordJoin(const std::string &name);
+
+  void recordRemoval(Id id);
+
+  // Writes the moves of a frame, preceded by a keyframe of the players before
+  // they move when one is due
+  void recordMoves(int frame, Id nextId, const PlayerTable &players,
+                   const std::map<Id, Direction> &directions);
+};
+
+// Re-simulates a recorded match, allowing to jump to any of its frames
+class ReplayPlayer {
+  struct Keyframe {
+    int frame;
+    std::size_t offset;
+  };
+
+  std::vector<char> data;
+  Configuration conf;
+  int keyframeInterval = 0;
+  std::size_t recordsBegin = 0;
+  std::size_t lastJoinEnd = 0;
+  std::vector<std::string> names; // In join order, the n-th join got id n+1
+  std::vector<Keyframe> keyframes;
+  int lastFrame = 0;
+
+  std::unique_ptr<Game> game;
+  std::map<Id, Direction> directions;
+  std::size_t position = 0;
+  int recordFrame = 0; // Base for the frame deltas at position
+  int frame = 0;       // Frame whose moves are applied next
+
+  void restart();
+  void restoreKeyframe(const Keyframe &keyframe);
+  // Applies the record at position and moves past it
+  void applyRecord();
+  // Frame of the moves record at position, or -1 if it is another record
+  int peekMovesFrame() const;
+
+public:
+  // Loads the whole replay in memory, throws std::runtime_error if it can not
+  // be read
+  ReplayPlayer(const std::string &path);
+
+  // Applies the moves of the current frame. Returns false at the end of the
+  // replay.
+  bool step();
+
+  // Brings the game to the state it had right before the moves of the given
+  // frame were applied, starting from the closest keyframe
+  void seek(int frame);
+
+  // Frame whose moves will be applied by the next step
+  int getFrame() const { return frame; }
+
+  // Number of frames with moves in the replay
+  int getFrameCount() const { return lastFrame + 1; }
+
+  const Configuration &getConfiguration() const { return conf; }
+
+  Game &getGame() { return *game; }
+};
+
+} // namespace cycles_server
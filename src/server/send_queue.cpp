@@ -0,0 +1,52 @@
+#include "send_queue.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace cycles_server {
+
+WireFrame makeWireFrame(const sf::Packet &packet) {
+  const auto size = static_cast<std::uint32_t>(packet.getDataSize());
+  auto frame = std::make_shared<std::vector<char>>(sizeof(size) + size);
+  // Same layout as sf::TcpSocket::send(sf::Packet&): big endian size first
+  for (std::size_t i = 0; i < sizeof(size); ++i) {
+    (*frame)[i] = static_cast<char>(size >> (8 * (sizeof(size) - 1 - i)));
+  }
+  if (size > 0) {
+    const auto *data = static_cast<const char *>(packet.getData());
+    std::copy(data, data + size, frame->begin() + sizeof(size));
+  }
+  return frame;
+}
+
+void SendQueue::push(WireFrame frame) { frames.push_back(std::move(frame)); }
+
+void SendQueue::coalesce(WireFrame frame) {
+  // A frame partly written must be finished or the stream would be corrupt
+  const std::size_t keep = sent > 0 ? 1 : 0;
+  dropped += static_cast<int>(frames.size() - keep);
+  frames.resize(keep);
+  frames.push_back(std::move(frame));
+}
+
+sf::Socket::Status SendQueue::flush(sf::TcpSocket &socket) {
+  while (!frames.empty()) {
+    const auto &frame = *frames.front();
+    std::size_t written = 0;
+    const auto status =
+        socket.send(frame.data() + sent, frame.size() - sent, written);
+    sent += written;
+    if (sent == frame.size()) {
+      frames.pop_front();
+      sent = 0;
+      continue;
+    }
+    if (status == sf::Socket::Done || status == sf::Socket::Partial) {
+      return sf::Socket::Partial;
+    }
+    return status;
+  }
+  dropped = 0;
+  return sf::Socket::Done;
+}
+
+} // namespace cycles_server
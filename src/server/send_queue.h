@@ -0,0 +1,52 @@
+#pragma once
+#include <SFML/Network.hpp>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace cycles_server {
+
+// A packet laid out as it goes on the wire (its size followed by its data),
+// shared by the queues of all the clients it is sent to
+using WireFrame = std::shared_ptr<const std::vector<char>>;
+
+WireFrame makeWireFrame(const sf::Packet &packet);
+
+// Outgoing frames of a client, written to its socket without ever blocking.
+// A frame may take several flushes to go out, the queue remembers how much of
+// it was written. The queue holds at most maxDepth frames: a client that falls
+// that far behind gets the frames that were not started replaced by the
+// latest one (see coalesce).
+class SendQueue {
+  std::deque<WireFrame> frames;
+  std::size_t sent = 0; // Bytes of the front frame already written
+  std::size_t maxDepth;
+  int dropped = 0;
+
+public:
+  explicit SendQueue(std::size_t maxDepth = 4) : maxDepth(maxDepth) {}
+
+  bool empty() const { return frames.empty(); }
+
+  std::size_t size() const { return frames.size(); }
+
+  bool isFull() const { return frames.size() >= maxDepth; }
+
+  // Queues a frame after the others, the queue must not be full
+  void push(WireFrame frame);
+
+  // Drops the frames that have not started to be written and queues frame
+  // instead. The frame must not depend on the ones dropped.
+  void coalesce(WireFrame frame);
+
+  // Number of frames dropped since the queue was last empty
+  int getDropped() const { return dropped; }
+
+  // Writes as much as the socket takes without blocking. Returns Done once the
+  // queue is empty, NotReady or Partial if frames are left, and the status of
+  // the socket if it failed.
+  sf::Socket::Status flush(sf::TcpSocket &socket);
+};
+
+} // namespace cycles_server
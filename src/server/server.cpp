@@ -1,12 +1,28 @@
 #include "server.h"
 #include "game_logic.h"
+#include "input_queue.h"
 #include "renderer.h"
+#include "replay.h"
+#include "send_queue.h"
+#include "shm_transport.h"
+#include "state_encoder.h"
+#include "tick_scheduler.h"
 #include <SFML/Network.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <set>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -16,14 +32,48 @@ using namespace cycles_server;
 class GameServer {
   sf::TcpListener listener;
   std::map<Id, std::shared_ptr<sf::TcpSocket>> clientSockets;
+  // Clients that receive the changes of every frame instead of the full
+  // state, with the last frame they received (-1 when they need a keyframe)
+  std::map<Id, int> deltaClients;
+  std::set<Id> compressingClients; // Clients that read compressed keyframes
+  std::map<Id, SendQueue> sendQueues; // Frames not yet written to each client
+  // Direction of each player, kept until its client sends a new one, and the
+  // moves of the clients that tag them
+  PlayerInputs inputs;
+  // Clients that read the game states from shared memory
+  struct SharedClient {
+    std::uint32_t slot;
+    std::uint32_t lastMove;           // Sequence of the last move read
+    std::uint32_t lastKeyframeRequest; // Count of keyframe requests seen
+    bool needsKeyframe = true;
+  };
+  std::unique_ptr<cycles::shm::Segment> sharedMemory;
+  std::map<Id, SharedClient> sharedClients;
+  std::vector<bool> usedSlots; // Move slots of the shared memory in use
+  // Read-only viewers, on their own listener. They are not players, so they
+  // do not count towards maxClients or the end of the game.
+  struct Spectator {
+    std::shared_ptr<sf::TcpSocket> socket;
+    SendQueue queue;
+    sf::Uint8 capabilities;
+    int lastFrame = -1; // Last frame queued, -1 when a keyframe is needed
+  };
+  // Connected spectators that have not sent their capabilities yet, with the
+  // frame they connected on
+  std::vector<std::pair<std::shared_ptr<sf::TcpSocket>, int>>
+      pendingSpectators;
+  std::list<Spectator> spectators;
+  sf::TcpListener spectatorListener;
+  bool acceptingSpectators = false;
   std::mutex serverMutex;
   std::shared_ptr<Game> game;
   const Configuration conf;
-  bool running;
+  std::atomic<bool> running;
 
 public:
   GameServer(std::shared_ptr<Game> game, Configuration conf)
       : game(game), conf(conf), running(false) {
+    game->trackChanges();
     const char *portenv = std::getenv("CYCLES_PORT");
     if (portenv == nullptr) {
       spdlog::critical("Please set the CYCLES_PORT environment variable");
@@ -37,6 +87,20 @@ public:
       spdlog::critical("Failed to bind to port {}", PORT);
       exit(1);
     }
+    if (const char *shmName = std::getenv(cycles::shm::environmentVariable)) {
+      createSharedMemory(shmName);
+    }
+    if (const char *spectatorPort = std::getenv("CYCLES_SPECTATOR_PORT")) {
+      const unsigned short port = std::stoi(spectatorPort);
+      spectatorListener.listen(port);
+      spectatorListener.setBlocking(false);
+      if (spectatorListener.getLocalPort() == 0) {
+        spdlog::critical("Failed to bind to spectator port {}", port);
+        exit(1);
+      }
+      acceptingSpectators = true;
+      spdlog::info("Listening for spectators on port {}", port);
+    }
   }
 
   void run() {
@@ -51,50 +115,249 @@ public:
 
   void setAcceptingClients(bool accepting) { acceptingClients = accepting; }
 
+  // Waits until count clients have joined, or timeout (forever if zero).
+  // Returns the number of clients that joined.
+  int waitForClients(int count, sf::Time timeout) {
+    std::unique_lock lock(joinMutex);
+    auto enough = [&] { return joinedClients >= count; };
+    if (timeout == sf::Time::Zero) {
+      joined.wait(lock, enough);
+    } else {
+      joined.wait_for(lock, std::chrono::microseconds(timeout.asMicroseconds()),
+                      enough);
+    }
+    return joinedClients;
+  }
+
   void acceptClients() {
-    while (acceptingClients &&
-           static_cast<int>(clientSockets.size()) < conf.maxClients) {
-      auto clientSocket = std::make_shared<sf::TcpSocket>();
-      if (listener.accept(*clientSocket) == sf::Socket::Done) {
-        clientSocket->setBlocking(
-            true); // Set to blocking for initial communication
-        // Receive player name
-        sf::Packet namePacket;
-        if (clientSocket->receive(namePacket) == sf::Socket::Done) {
-          std::string playerName;
-          namePacket >> playerName;
-          auto id = game->addPlayer(playerName);
-          // Send color to the client
-          sf::Packet colorPacket;
-          const auto &player = game->getPlayers().at(id);
-          colorPacket << player.color.r << player.color.g << player.color.b;
-          if (clientSocket->send(colorPacket) != sf::Socket::Done) {
-            spdlog::critical("Failed to send color to client: {}", playerName);
-          } else {
-            spdlog::info("Color sent to client: {}", playerName);
-          }
-          clientSocket->setBlocking(
-              false); // Set back to non-blocking for game loop
-          clientSockets[id] = clientSocket;
-          spdlog::info("New client connected: {} with id {}", playerName, id);
+    // Handshakes progress as their clients send their name, so that a client
+    // that connects and stays silent does not hold back the others
+    sf::SocketSelector selector;
+    selector.add(listener);
+    std::list<Handshake> handshakes;
+    sf::Clock clock;
+    // The listener is only read while there are places left
+    while (acceptingClients && !isFull()) {
+      // Wake up when a client connects or sends its name, when the oldest
+      // handshake times out, or regularly to notice that clients are no
+      // longer accepted
+      auto timeout = accept_poll_interval;
+      if (!handshakes.empty()) {
+        timeout = std::clamp(handshakes.front().deadline -
+                                 clock.getElapsedTime(),
+                             sf::milliseconds(1), accept_poll_interval);
+      }
+      if (selector.wait(timeout)) {
+        if (selector.isReady(listener)) {
+          acceptConnections(selector, handshakes,
+                            clock.getElapsedTime() + max_handshake_time);
         }
+        std::erase_if(handshakes, [&](const Handshake &handshake) {
+          auto &socket = *handshake.socket;
+          if (!selector.isReady(socket)) {
+            return false;
+          }
+          sf::Packet namePacket;
+          const auto status = socket.receive(namePacket);
+          if (status == sf::Socket::Done && isFull()) {
+            // Clients that were accepted together can outnumber the places
+            spdlog::warn("Rejecting client {}, the game is full",
+                         socket.getRemoteAddress().toString());
+            rejectClient(socket);
+          } else if (status == sf::Socket::Done) {
+            addClient(handshake.socket, namePacket);
+          } else if (!isDisconnected(status)) {
+            return false; // Only part of the name has arrived
+          }
+          selector.remove(socket);
+          return true;
+        });
+      }
+      // Handshakes all have the same time limit, so the oldest come first
+      while (!handshakes.empty() &&
+             handshakes.front().deadline <= clock.getElapsedTime()) {
+        spdlog::warn("Dropping client {}, it did not send its name in time",
+                     handshakes.front().socket->getRemoteAddress().toString());
+        selector.remove(*handshakes.front().socket);
+        handshakes.pop_front();
       }
     }
+    // No more players can join, the clients still sending their name read
+    // the rejection after it
+    for (const auto &handshake : handshakes) {
+      rejectClient(*handshake.socket);
+    }
   }
 
 private:
   int frame = 0;
+
+  // A client that connected and has not sent its name yet
+  struct Handshake {
+    std::shared_ptr<sf::TcpSocket> socket;
+    sf::Time deadline; // On the clock of acceptClients
+  };
+
+  bool isFull() const {
+    return static_cast<int>(clientSockets.size()) >= conf.maxClients;
+  }
+
+  // Accepts all the clients waiting on the listener, they are added to the
+  // selector to be woken up by their name
+  void acceptConnections(sf::SocketSelector &selector,
+                         std::list<Handshake> &handshakes, sf::Time deadline) {
+    while (true) {
+      auto clientSocket = std::make_shared<sf::TcpSocket>();
+      if (listener.accept(*clientSocket) != sf::Socket::Done) {
+        return;
+      }
+      clientSocket->setBlocking(false);
+      selector.add(*clientSocket);
+      handshakes.push_back({clientSocket, deadline});
+    }
+  }
+
+  // Adds the player of a client that sent its name, and answers with its
+  // color
+  void addClient(std::shared_ptr<sf::TcpSocket> clientSocket,
+                 sf::Packet &namePacket) {
+    std::string playerName;
+    sf::Uint8 capabilities = 0;
+    namePacket >> playerName >> capabilities;
+    auto id = game->addPlayer(playerName);
+    if (id == 0) {
+      spdlog::error("Rejecting client {}, the grid is full", playerName);
+      rejectClient(*clientSocket);
+      return;
+    }
+    if (!conf.headless) {
+      game->publishSnapshot();
+    }
+    // Send color to the client
+    sf::Packet colorPacket;
+    const auto &player = game->getPlayers().at(id);
+    colorPacket << player.color.r << player.color.g << player.color.b
+                << static_cast<sf::Uint8>(sizeof(Id));
+    std::optional<sf::Uint16> slot;
+    if ((capabilities & cycles::protocol::sharedMemory) && sharedMemory) {
+      slot = addSharedClient(id);
+    }
+    const bool shared = slot.has_value();
+    if (shared) {
+      colorPacket << *slot;
+    }
+    // The socket is non-blocking, but the few bytes of the color fit in its
+    // empty buffer
+    auto status = clientSocket->send(colorPacket);
+    while (status == sf::Socket::Partial) {
+      status = clientSocket->send(colorPacket);
+    }
+    if (status != sf::Socket::Done) {
+      spdlog::critical("Failed to send color to client: {}", playerName);
+    } else {
+      spdlog::info("Color sent to client: {}", playerName);
+    }
+    clientSockets[id] = clientSocket;
+    sendQueues.try_emplace(id, max_send_queue_depth);
+    if (capabilities & cycles::protocol::deltaStates && !shared) {
+      deltaClients[id] = -1;
+    }
+    if (capabilities & cycles::protocol::compressedTiles) {
+      compressingClients.insert(id);
+    }
+    inputs.add(id,
+               initialDirection(game->getPlayers().at(id).position,
+                                conf.gridWidth, conf.gridHeight),
+               capabilities & cycles::protocol::taggedMoves);
+    spdlog::info("New client connected: {} with id {}", playerName, id);
+    {
+      std::scoped_lock lock(joinMutex);
+      joinedClients++;
+    }
+    joined.notify_all();
+  }
+
+  // Tells a client that it can not join, the socket is closed when the
+  // caller drops it
+  static void rejectClient(sf::TcpSocket &clientSocket) {
+    sf::Packet rejectPacket;
+    rejectPacket << sf::Uint8(0) << sf::Uint8(0) << sf::Uint8(0)
+                 << cycles::protocol::rejected;
+    auto status = clientSocket.send(rejectPacket);
+    while (status == sf::Socket::Partial) {
+      status = clientSocket.send(rejectPacket);
+    }
+  }
+
+  void createSharedMemory(const std::string &name) {
+    // Large enough for a few keyframes of a grid full of single cell runs
+    const std::uint64_t ringSize =
+        std::max<std::uint64_t>(16 << 20, std::uint64_t(8) * conf.gridWidth *
+                                              conf.gridHeight * sizeof(Id));
+    try {
+      sharedMemory = cycles::shm::Segment::create(name, sizeof(Id),
+                                                  conf.maxClients, ringSize);
+    } catch (const std::runtime_error &error) {
+      spdlog::critical("{}", error.what());
+      exit(1);
+    }
+    usedSlots.assign(conf.maxClients, false);
+    spdlog::info("Sending game states through shared memory {}", name);
+  }
+
+  // Gives a move slot to a client, there is one per client that can join.
+  // Without a free slot the client is left on TCP.
+  std::optional<sf::Uint16> addSharedClient(Id id) {
+    const auto free = std::find(usedSlots.begin(), usedSlots.end(), false);
+    if (free == usedSlots.end()) {
+      spdlog::warn("No free shared memory slot for client {}, sending its "
+                   "game states over TCP",
+                   id);
+      return std::nullopt;
+    }
+    const auto slot = static_cast<std::uint32_t>(free - usedSlots.begin());
+    *free = true;
+    const auto &moveSlot = sharedMemory->moveSlot(slot);
+    sharedClients[id] = {slot, moveSlot.sequence.load(),
+                         moveSlot.keyframeRequests.load()};
+    return static_cast<sf::Uint16>(slot);
+  }
+
   const int max_client_communication_time = 50; // ms
+  const sf::Time accept_poll_interval = sf::milliseconds(100);
+  const sf::Time max_handshake_time = sf::seconds(2); // To send the name
+  const std::size_t max_send_queue_depth = 4; // Frames
+  const int shared_move_poll_interval = 100;  // us
+  const int max_dropped_frames = 60; // In a row, before dropping the client
 
-  bool acceptingClients = true;
+  std::atomic<bool> acceptingClients = true;
+  // Signaled when a client joins, for waitForClients
+  std::mutex joinMutex;
+  std::condition_variable joined;
+  int joinedClients = 0;
+  sf::SocketSelector inputSelector; // Clients whose input is awaited
+
+  void removeClient(Id id) {
+    game->removePlayer(id);
+    clientSockets.erase(id);
+    deltaClients.erase(id);
+    compressingClients.erase(id);
+    sendQueues.erase(id);
+    inputs.remove(id);
+    if (auto client = sharedClients.find(id); client != sharedClients.end()) {
+      usedSlots[client->second.slot] = false;
+      sharedClients.erase(client);
+    }
+  }
 
   void checkPlayers() {
     // Remove sockets from players that have died or disconnected
     spdlog::debug("Server ({}): Checking players", frame);
-    auto players = game->getPlayers();
+    const auto &players = game->getPlayers();
+    std::vector<Id> removed;
     for (const auto &[id, socket] : clientSockets) {
       bool remove = false;
-      if (players.find(id) == players.end()) {
+      if (!players.contains(id)) {
         spdlog::info("Player {} has died", id);
         remove = true;
       }
@@ -102,134 +365,592 @@ private:
         spdlog::info("Player {} has disconnected", id);
         remove = true;
       }
+      // Clients that keep falling behind only get a fraction of the frames
+      const auto &queue = sendQueues.at(id);
+      if (queue.getDropped() > max_dropped_frames) {
+        spdlog::info("Player {} is not keeping up, {} frames dropped", id,
+                     queue.getDropped());
+        remove = true;
+      }
       if (remove) {
-        game->removePlayer(id);
-        clientSockets.erase(id);
+        removed.push_back(id);
       }
     }
+    for (auto id : removed) {
+      removeClient(id);
+    }
   }
 
-  auto receiveClientInput(auto clientSockets) {
-    spdlog::debug("Server ({}): Receiving client input from {} clients", frame,
-                  clientSockets.size());
-    if (clientSockets.size() == 0) {
-      return std::map<Id, Direction>();
-    }
-    std::map<Id, Direction> successful;
-    for (const auto &[id, clientSocket] : clientSockets) {
-      auto name = game->getPlayers().at(id).name;
-      spdlog::debug("Server ({}): Receiving input from player {} ({})", frame,
-                    id, name);
+  // A move read from a client, with the frame whose state it answers (-1 if
+  // the client does not tag its moves)
+  struct ClientInput {
+    Direction direction = Direction::north;
+    int frame = -1;
+  };
+
+  // Reads a move of a client whose socket is ready. Returns Done if a whole
+  // move was read, NotReady or Partial if there is nothing more to read yet.
+  sf::Socket::Status receiveClientInput(Id id, sf::TcpSocket &clientSocket,
+                                        ClientInput &input) {
+    const auto &name = game->getPlayers().at(id).name;
+    spdlog::debug("Server ({}): Receiving input from player {} ({})", frame, id,
+                  name);
+    sf::Packet packet;
+    auto status = clientSocket.receive(packet);
+    if (status != sf::Socket::Done) {
+      return status;
+    }
+    int value;
+    sf::Uint8 resync = 0;
+    packet >> value >> resync;
+    if (resync == cycles::protocol::resync && deltaClients.contains(id)) {
+      deltaClients[id] = -1;
+    }
+    input.frame = -1;
+    if (inputs.isTagged(id)) {
+      sf::Int32 moveFrame = -1;
+      packet >> moveFrame;
+      input.frame = moveFrame;
+    }
+    spdlog::debug("Received direction {} for frame {} from player {} ({})",
+                  value, input.frame, id, name);
+    input.direction = static_cast<Direction>(value);
+    return sf::Socket::Done;
+  }
+
+  static bool isDisconnected(sf::Socket::Status status) {
+    return status == sf::Socket::Disconnected || status == sf::Socket::Error;
+  }
+
+  StateEncoder encoder;
+
+  // Kind of state a client gets this frame
+  StateEncoder::Kind getStateKind(Id id) {
+    auto client = deltaClients.find(id);
+    if (client == deltaClients.end()) {
+      return StateEncoder::full;
+    }
+    if (client->second == frame - 1) {
+      return StateEncoder::delta;
+    }
+    return compressingClients.contains(id) ? StateEncoder::compressedKeyframe
+                                           : StateEncoder::keyframe;
+  }
+
+  StateEncoder::Kind getStateKind(const Spectator &spectator) const {
+    using cycles::protocol::Capability;
+    if (!(spectator.capabilities & Capability::deltaStates)) {
+      return StateEncoder::full;
+    }
+    if (spectator.lastFrame == frame - 1) {
+      return StateEncoder::delta;
+    }
+    return spectator.capabilities & Capability::compressedTiles
+               ? StateEncoder::compressedKeyframe
+               : StateEncoder::keyframe;
+  }
+
+  // Accepts the spectators waiting on their listener, and adds those that
+  // sent their capabilities (a Uint8) to the spectators
+  void acceptSpectators() {
+    while (acceptingSpectators) {
+      auto socket = std::make_shared<sf::TcpSocket>();
+      if (spectatorListener.accept(*socket) != sf::Socket::Done) {
+        break;
+      }
+      socket->setBlocking(false);
+      pendingSpectators.emplace_back(socket, frame);
+    }
+    std::erase_if(pendingSpectators, [&](const auto &pending) {
+      const auto &[socket, connectedFrame] = pending;
       sf::Packet packet;
-      auto status = clientSocket->receive(packet);
-      if (status == sf::Socket::Done) {
-        int direction;
-        packet >> direction;
-        spdlog::debug("Received direction {} from player {} ({})", direction,
-                      id, name);
-        successful[id] = static_cast<Direction>(direction);
+      const auto status = socket->receive(packet);
+      sf::Uint8 capabilities = 0;
+      if (status == sf::Socket::Done && packet >> capabilities) {
+        spectators.push_back({socket, SendQueue(max_send_queue_depth),
+                              capabilities});
+        spdlog::info("Server ({}): New spectator, {} watching", frame,
+                     spectators.size());
+        return true;
+      }
+      // Spectators have a second to say hello
+      return isDisconnected(status) || frame - connectedFrame > conf.tickRate;
+    });
+  }
+
+  void prepareGameState() {
+    int kinds = 0;
+    // Shared memory clients all read the same deltas, and the keyframes
+    // requested by any of them
+    for (auto &[id, client] : sharedClients) {
+      const auto requests = sharedMemory->moveSlot(client.slot)
+                                .keyframeRequests.load(
+                                    std::memory_order_acquire);
+      if (requests != client.lastKeyframeRequest) {
+        client.lastKeyframeRequest = requests;
+        client.needsKeyframe = true;
+      }
+      kinds |= StateEncoder::delta;
+      if (client.needsKeyframe) {
+        kinds |= StateEncoder::compressedKeyframe;
       }
     }
-    return successful;
+    for (const auto &[id, socket] : clientSockets) {
+      if (sharedClients.contains(id)) {
+        continue;
+      }
+      // The frames queued for a client that is too far behind are replaced
+      // by the latest state, which must then be a keyframe
+      if (sendQueues.at(id).isFull() && deltaClients.contains(id)) {
+        deltaClients[id] = -1;
+      }
+      kinds |= getStateKind(id);
+    }
+    for (auto &spectator : spectators) {
+      if (spectator.queue.isFull()) {
+        spectator.lastFrame = -1;
+      }
+      kinds |= getStateKind(spectator);
+    }
+    encoder.encode(*game, frame, kinds);
   }
 
-  auto sendGameState(auto clientSockets) {
-    spdlog::debug("Server ({}): Sending game state to {} clients", frame,
+  // Queues the state of the frame for every client, without waiting for it
+  // to be written
+  void queueGameState() {
+    spdlog::debug("Server ({}): Queueing game state for {} clients", frame,
                   clientSockets.size());
-    if (clientSockets.size() == 0) {
-      return std::vector<Id>();
+    // Each kind of state is serialised once, and shared by every client and
+    // spectator that gets it
+    std::map<StateEncoder::Kind, WireFrame> wireFrames;
+    auto getWireFrame = [&](StateEncoder::Kind kind) {
+      auto &wireFrame = wireFrames[kind];
+      if (!wireFrame) {
+        wireFrame = makeWireFrame(encoder.getPacket(kind));
+      }
+      return wireFrame;
+    };
+    for (const auto &[id, socket] : clientSockets) {
+      if (sharedClients.contains(id)) {
+        continue;
+      }
+      const auto wireFrame = getWireFrame(getStateKind(id));
+      auto &queue = sendQueues.at(id);
+      if (queue.isFull()) {
+        spdlog::debug("Server ({}): Player {} is lagging, dropping {} frames",
+                      frame, id, queue.size() - 1);
+        queue.coalesce(wireFrame);
+      } else {
+        queue.push(wireFrame);
+      }
+      if (deltaClients.contains(id)) {
+        deltaClients[id] = frame;
+      }
     }
-    sf::Packet packet;
-    packet << conf.gridWidth << conf.gridHeight;
-    const auto &grid = game->getGrid();
-    auto players = game->getPlayers();
-    packet << static_cast<sf::Uint32>(players.size());
-    for (const auto &[id, player] : players) {
-      packet << player.position.x << player.position.y << player.color.r
-             << player.color.g << player.color.b << player.name << id << frame;
-    }
-    for (auto &cell : grid) {
-      packet << cell;
-    }
-    std::vector<Id> successful;
-    for (const auto &[id, clientSocket] : clientSockets) {
-      if (clientSocket->send(packet) != sf::Socket::Done) {
-        spdlog::debug("Server ({}): Failed to send game state to player {}",
-                      frame, id);
+    // Slow spectators get a keyframe replacing the frames they are late on
+    // (see prepareGameState), but are never dropped for it
+    for (auto &spectator : spectators) {
+      const auto wireFrame = getWireFrame(getStateKind(spectator));
+      if (spectator.queue.isFull()) {
+        spectator.queue.coalesce(wireFrame);
       } else {
-        successful.push_back(id);
-        spdlog::debug("Server ({}): Game state sent to player {}", frame, id);
+        spectator.queue.push(wireFrame);
       }
+      spectator.lastFrame = frame;
     }
-    return successful;
   }
 
-  void gameLoop() {
-    sf::Clock clock;
-    sf::Clock clientCommunicationClock;
-    while (running && !game->isGameOver()) {
-      if (clock.getElapsedTime().asMilliseconds() >= 33) { // ~30 fps
-        clock.restart();
-        std::scoped_lock lock(serverMutex);
-        game->setFrame(frame);
-        checkPlayers();
-        auto clientsUnsent = clientSockets;
-        decltype(clientSockets) toRecieve;
-        std::map<Id, Direction> newDirs;
-        std::set<Id> timedOutPlayers;
-        clientCommunicationClock.restart();
-        while (clientsUnsent.size() > 0 || toRecieve.size() > 0) {
-          auto successful = sendGameState(clientsUnsent);
-          for (auto s : successful) {
-            clientsUnsent.erase(s);
-            toRecieve[s] = clientSockets[s];
-          }
-          auto succesfulrec = receiveClientInput(toRecieve);
-          for (auto s : succesfulrec) {
-            toRecieve.erase(s.first);
-            newDirs[s.first] = s.second;
-          }
-          spdlog::debug("Server ({}): Clients unsent: {}", frame,
-                        clientsUnsent.size());
-          spdlog::debug("Server ({}): Clients to recieve: {}", frame,
-                        toRecieve.size());
-          // Check for clients that have not sent input for a long time
-          if (clientCommunicationClock.getElapsedTime().asMilliseconds() >
-              max_client_communication_time) {
-            // Mark all remaining clients for removal
-            for (auto [id, socket] : clientsUnsent) {
-              timedOutPlayers.insert(id);
-            }
-            for (auto [id, socket] : toRecieve) {
-              timedOutPlayers.insert(id);
-            }
-            break;
-          }
+  // Writes the state of the frame once for all the shared memory clients
+  void writeSharedState() {
+    if (sharedClients.empty()) {
+      return;
+    }
+    auto write = [&](StateEncoder::Kind kind) {
+      const auto &packet = encoder.getPacket(kind);
+      try {
+        cycles::shm::writeFrame(*sharedMemory, packet.getData(),
+                                packet.getDataSize());
+      } catch (const std::runtime_error &error) {
+        spdlog::error("Server ({}): {}", frame, error.what());
+      }
+    };
+    write(StateEncoder::delta);
+    bool keyframe = false;
+    for (auto &[id, client] : sharedClients) {
+      keyframe = keyframe || client.needsKeyframe;
+      client.needsKeyframe = false;
+    }
+    if (keyframe) {
+      write(StateEncoder::compressedKeyframe);
+    }
+  }
+
+  // Reads the move of a shared memory client, if it wrote a new one
+  bool receiveSharedInput(Id id, ClientInput &input) {
+    auto &client = sharedClients.at(id);
+    cycles::shm::Move move;
+    if (!cycles::shm::readMove(sharedMemory->moveSlot(client.slot),
+                               client.lastMove, move)) {
+      return false;
+    }
+    input.frame = move.frame;
+    input.direction = static_cast<Direction>(move.direction);
+    return true;
+  }
+
+  // Writes the queued frames as far as the sockets allow. Returns the clients
+  // whose connection failed.
+  std::vector<Id> flushGameState() {
+    std::vector<Id> failed;
+    for (auto &[id, queue] : sendQueues) {
+      if (queue.empty()) {
+        continue;
+      }
+      const auto status = queue.flush(*clientSockets.at(id));
+      if (status == sf::Socket::Disconnected ||
+          status == sf::Socket::Error) {
+        failed.push_back(id);
+      }
+    }
+    std::erase_if(spectators, [&](Spectator &spectator) {
+      if (!isDisconnected(spectator.queue.flush(*spectator.socket))) {
+        return false;
+      }
+      spdlog::info("Server ({}): Spectator left, {} watching", frame,
+                   spectators.size() - 1);
+      return true;
+    });
+    return failed;
+  }
+
+  bool hasQueuedFrames() const {
+    for (const auto &[id, queue] : sendQueues) {
+      if (!queue.empty()) {
+        return true;
+      }
+    }
+    for (const auto &spectator : spectators) {
+      if (!spectator.queue.empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Keeps writing the queued frames until they are all out or the deadline
+  // is reached, between two ticks
+  void drainGameState(TickScheduler::Clock::time_point deadline) {
+    using namespace std::chrono;
+    while (hasQueuedFrames()) {
+      for (auto id : flushGameState()) {
+        spdlog::info("Player {} has disconnected", id);
+        removeClient(id);
+      }
+      const auto wait = duration_cast<microseconds>(
+          deadline - TickScheduler::Clock::now());
+      if (wait.count() <= 0) {
+        break;
+      }
+      sf::sleep(sf::microseconds(std::min<long>(wait.count(), 1000)));
+    }
+  }
+
+  // Lockstep mode: waits for the move of every client for the current frame,
+  // until the client communication deadline. Clients that are behind are not
+  // waited for, their players keep the direction of the last move they sent.
+  void receiveLockstepInput(std::map<Id, Direction> &newDirs,
+                            std::set<Id> &timedOutPlayers,
+                            std::set<Id> &disconnectedPlayers) {
+    using namespace std::chrono;
+    // Moves are awaited from the clients that are keeping up, those that
+    // still have older frames queued answer whenever they get there and move
+    // on their last direction in the meantime
+    std::set<Id> awaited;
+    inputSelector.clear();
+    for (const auto &[id, socket] : clientSockets) {
+      if (sharedClients.contains(id) || sendQueues.at(id).size() == 1) {
+        awaited.insert(id);
+      }
+      inputSelector.add(*socket);
+    }
+    const auto deadline = TickScheduler::Clock::now() +
+                          milliseconds(max_client_communication_time);
+    while (awaited.size() > 0) {
+      for (auto id : flushGameState()) {
+        disconnectedPlayers.insert(id);
+        awaited.erase(id);
+        inputSelector.remove(*clientSockets.at(id));
+      }
+      for (const auto &[id, client] : sharedClients) {
+        ClientInput input;
+        if (!awaited.contains(id) || !receiveSharedInput(id, input)) {
+          continue;
+        }
+        inputs.set(id, input.direction);
+        if (input.frame < frame) {
+          spdlog::debug("Server ({}): Discarding move of player {} for "
+                        "frame {}",
+                        frame, id, input.frame);
+          continue;
+        }
+        newDirs[id] = input.direction;
+        awaited.erase(id);
+      }
+      if (awaited.empty()) {
+        break;
+      }
+      // Sleep until some input arrives. Sends that did not complete can not
+      // be waited for, they are retried every millisecond.
+      auto wait = duration_cast<microseconds>(
+          deadline - TickScheduler::Clock::now());
+      bool sending = false;
+      bool sharing = false;
+      for (auto id : awaited) {
+        sending = sending || !sendQueues.at(id).empty();
+        sharing = sharing || sharedClients.contains(id);
+      }
+      if (sending) {
+        wait = std::min(wait, microseconds(1000));
+      }
+      // Moves in shared memory do not wake up the selector, they are polled
+      if (sharing) {
+        wait = std::min(wait, microseconds(shared_move_poll_interval));
+      }
+      // A wait of 0 would block forever
+      if (wait.count() <= 0) {
+        timedOutPlayers = std::move(awaited);
+        break;
+      }
+      if (!inputSelector.wait(sf::microseconds(wait.count()))) {
+        continue;
+      }
+      for (const auto &[id, socket] : clientSockets) {
+        if (disconnectedPlayers.contains(id) || newDirs.contains(id) ||
+            !inputSelector.isReady(*socket)) {
+          continue;
+        }
+        ClientInput input;
+        const auto status = receiveClientInput(id, *socket, input);
+        if (isDisconnected(status)) {
+          disconnectedPlayers.insert(id);
+        } else if (status != sf::Socket::Done) {
+          continue;
+        } else if (input.frame >= 0 && input.frame < frame) {
+          // Answer to a state that was already played. It is the latest
+          // direction of a client that is behind, a client that is keeping
+          // up is still expected to answer the current state.
+          inputs.set(id, input.direction);
+          spdlog::debug("Server ({}): Discarding move of player {} for "
+                        "frame {}",
+                        frame, id, input.frame);
+          continue;
+        } else {
+          newDirs[id] = input.direction;
+          inputs.set(id, input.direction);
+        }
+        awaited.erase(id);
+        inputSelector.remove(*socket);
+      }
+    }
+    for (const auto &[id, socket] : clientSockets) {
+      if (!newDirs.contains(id) && !timedOutPlayers.contains(id) &&
+          !disconnectedPlayers.contains(id)) {
+        newDirs[id] = inputs.get(id);
+      }
+    }
+  }
+
+  // Free running mode: reads the moves that arrive until deadline, writing
+  // the queued frames in the meantime, without waiting for any client
+  void receiveFreeRunningInput(TickScheduler::Clock::time_point deadline,
+                               std::set<Id> &disconnectedPlayers) {
+    using namespace std::chrono;
+    inputSelector.clear();
+    for (const auto &[id, socket] : clientSockets) {
+      inputSelector.add(*socket);
+    }
+    while (true) {
+      for (auto id : flushGameState()) {
+        if (disconnectedPlayers.insert(id).second) {
+          inputSelector.remove(*clientSockets.at(id));
+        }
+      }
+      auto wait = duration_cast<microseconds>(
+          deadline - TickScheduler::Clock::now());
+      if (hasQueuedFrames()) {
+        wait = std::min(wait, microseconds(1000));
+      }
+      if (wait.count() <= 0) {
+        break;
+      }
+      if (!inputSelector.wait(sf::microseconds(wait.count()))) {
+        continue;
+      }
+      for (const auto &[id, socket] : clientSockets) {
+        if (disconnectedPlayers.contains(id) ||
+            !inputSelector.isReady(*socket)) {
+          continue;
+        }
+        // Read every move available, they are sorted out by frame later
+        ClientInput input;
+        auto status = receiveClientInput(id, *socket, input);
+        for (; status == sf::Socket::Done;
+             status = receiveClientInput(id, *socket, input)) {
+          inputs.push(id, input.frame, input.direction);
         }
-        for (auto id : timedOutPlayers) {
-          spdlog::info(
-              "Server ({}): Client {} has not sent input for a long time",
-              frame, id);
-          game->removePlayer(id);
-          clientSockets.erase(id);
-          newDirs.erase(id);
+        if (isDisconnected(status)) {
+          disconnectedPlayers.insert(id);
+          inputSelector.remove(*socket);
         }
-        game->movePlayers(newDirs);
-        frame++;
       }
     }
   }
+
+  // Free running mode: the moves for the current frame. Players whose move
+  // did not arrive in time keep their previous direction, or the one they
+  // were given when they joined.
+  std::map<Id, Direction> takeFreeRunningMoves() {
+    // Shared memory slots only hold the latest move
+    for (const auto &[id, client] : sharedClients) {
+      ClientInput input;
+      if (receiveSharedInput(id, input) && input.frame == frame) {
+        inputs.set(id, input.direction);
+      }
+    }
+    return inputs.take(frame);
+  }
+
+  void gameLoop() {
+    using namespace std::chrono;
+    TickScheduler scheduler(conf.tickRate);
+    while (running && !game->isGameOver()) {
+      const int skipped = scheduler.waitForTick();
+      if (skipped > 0) {
+        spdlog::warn("Server ({}): Frame took longer than its budget of {} "
+                     "ms, {} ticks skipped",
+                     frame,
+                     duration_cast<milliseconds>(scheduler.getPeriod()).count(),
+                     skipped);
+      }
+      std::scoped_lock lock(serverMutex);
+      game->setFrame(frame);
+      checkPlayers();
+      acceptSpectators();
+      prepareGameState();
+      queueGameState();
+      writeSharedState();
+      std::map<Id, Direction> newDirs;
+      std::set<Id> timedOutPlayers;
+      std::set<Id> disconnectedPlayers;
+      if (conf.freeRunning) {
+        receiveFreeRunningInput(scheduler.getDeadline(), disconnectedPlayers);
+        newDirs = takeFreeRunningMoves();
+      } else {
+        receiveLockstepInput(newDirs, timedOutPlayers, disconnectedPlayers);
+      }
+      for (auto id : disconnectedPlayers) {
+        spdlog::info("Player {} has disconnected", id);
+      }
+      for (auto id : timedOutPlayers) {
+        spdlog::info(
+            "Server ({}): Client {} has not sent input for a long time",
+            frame, id);
+      }
+      timedOutPlayers.merge(disconnectedPlayers);
+      for (auto id : timedOutPlayers) {
+        removeClient(id);
+        newDirs.erase(id);
+      }
+      game->movePlayers(newDirs);
+      // Snapshots are only read by the renderer
+      if (!conf.headless) {
+        game->publishSnapshot();
+      }
+      frame++;
+      drainGameState(scheduler.getDeadline());
+    }
+  }
 };
 
+// Quotes a string for JSON
+std::string toJson(const std::string &text) {
+  std::string quoted = "\"";
+  for (const char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      quoted += escaped;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + '"';
+}
+
+// Plays a match without a window: it starts once enough clients joined or
+// the join timeout passed, and its result is printed as a line of JSON on the
+// standard output. Returns the exit status of the server.
+int runHeadless(GameServer &server, Game &game, const Configuration &conf) {
+  std::thread acceptThread(&GameServer::acceptClients, &server);
+  const int startPlayers =
+      conf.startPlayers > 0 ? conf.startPlayers : conf.maxClients;
+  const int joined =
+      server.waitForClients(startPlayers, sf::seconds(conf.joinTimeout));
+  server.setAcceptingClients(false);
+  acceptThread.join();
+  if (joined == 0) {
+    spdlog::error("No client joined in {} s, not starting the match",
+                  conf.joinTimeout);
+    std::printf("{\"frames\":0,\"seed\":%u,\"winner\":null,"
+                "\"survivors\":[]}\n",
+                game.getSeed());
+    return 1;
+  }
+  spdlog::info("Starting the match with {} players", joined);
+  server.run();
+  std::string survivors;
+  for (const auto &player : game.getPlayers()) {
+    survivors += (survivors.empty() ? "" : ",") +
+                 fmt::format("{{\"id\":{},\"name\":{}}}", player.id,
+                             toJson(player.name));
+  }
+  const auto &players = game.getPlayers();
+  const auto winner = players.size() == 1
+                          ? fmt::format("{{\"id\":{},\"name\":{}}}",
+                                        players.begin()->id,
+                                        toJson(players.begin()->name))
+                          : "null";
+  std::printf("%s\n", fmt::format("{{\"frames\":{},\"seed\":{},"
+                                  "\"winner\":{},\"survivors\":[{}]}}",
+                                  server.getFrame(), game.getSeed(), winner,
+                                  survivors)
+                          .c_str());
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
 #if SPDLOG_ACTIVE_LEVEL == SPDLOG_LEVEL_TRACE
   spdlog::set_level(spdlog::level::debug);
 #endif
-  std::srand(static_cast<unsigned int>(std::time(nullptr)));
   const std::string config_path = argc > 1 ? argv[1] : "config.yaml";
   const Configuration conf(config_path);
+  if (conf.headless) {
+    // The standard output is left for the result of the match
+    spdlog::set_default_logger(spdlog::stderr_color_mt("server"));
+  }
   auto game = std::make_shared<Game>(conf);
+  spdlog::info("Game seed: {}", game->getSeed());
+  if (!conf.replayFile.empty()) {
+    game->setRecorder(std::make_shared<ReplayRecorder>(conf.replayFile, conf,
+                                                       game->getSeed()));
+  }
   GameServer server(game, conf);
+  if (conf.headless) {
+    return runHeadless(server, *game, conf);
+  }
   GameRenderer renderer(conf);
   std::thread acceptThread(&GameServer::acceptClients, &server);
   bool acceptingClients = true;
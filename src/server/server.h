@@ -1,7 +1,7 @@
 #pragma once
 #include "api.h"
+#include "tail.h"
 #include <SFML/Main.hpp>
-#include <list>
 
 namespace cycles_server {
 using cycles::Direction;
@@ -9,11 +9,11 @@ using cycles::Id;
 
 struct Player {
   sf::Vector2i position;
-  std::list<sf::Vector2i> tail;
+  Tail tail;
   sf::Color color;
   std::string name;
   Id id;
-  Player() : id(std::rand()) {}
+  Player() : id(0) {}
 };
 
 
@@ -27,6 +27,17 @@ struct Configuration {
   int gameBannerHeight = 100;
   float cellSize = 10;
   bool enablePostProcessing = false;
+  int tickRate = 30;      // Frames per second
+  bool freeRunning = false; // Play frames without waiting for the clients
+  unsigned int seed = 0;  // Seed for the game, 0 picks a random one
+  std::string replayFile; // If not empty, the match is recorded there
+  // Run without a window, starting the match once startPlayers clients have
+  // joined (0 for maxClients) or joinTimeout seconds have passed (0 to wait
+  // forever), and exiting with the result when it ends
+  bool headless = false;
+  int startPlayers = 0;
+  int joinTimeout = 30;
+  Configuration() = default;
   Configuration(std::string configPath);
 };
 } // namespace cycles_server
@@ -0,0 +1,129 @@
+#include "state_encoder.h"
+#include "tile_codec.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace cycles_server {
+
+using namespace cycles::protocol;
+
+void StateEncoder::writeFullState(sf::Packet &packet, Game &game, int frame) {
+  const auto &grid = game.getGrid();
+  packet << grid.getWidth() << grid.getHeight();
+  const auto &players = game.getPlayers();
+  packet << static_cast<sf::Uint32>(players.size());
+  for (const auto &player : players) {
+    packet << player.position.x << player.position.y << player.color.r
+           << player.color.g << player.color.b << player.name << player.id
+           << frame;
+  }
+  packet << grid;
+}
+
+void StateEncoder::writeFrame(sf::Packet &packet, Game &game, int frame,
+                              StateKind kind, bool compressed) {
+  const auto &grid = game.getGrid();
+  const auto &players = game.getPlayers();
+  playerRecords.clear();
+  names.clear();
+  for (const auto &player : players) {
+    PlayerRecord record{};
+    record.x = player.position.x;
+    record.y = player.position.y;
+    record.id = player.id;
+    record.r = player.color.r;
+    record.g = player.color.g;
+    record.b = player.color.b;
+    // Both lists of ids are sorted
+    record.isNew = kind == cycles::protocol::keyframe ||
+                   !std::binary_search(previousIds.begin(), previousIds.end(),
+                                       player.id);
+    if (record.isNew) {
+      record.nameOffset = names.size();
+      record.nameLength = std::min<std::size_t>(
+          player.name.size(), std::numeric_limits<std::uint16_t>::max());
+      names.append(player.name, 0, record.nameLength);
+    }
+    playerRecords.push_back(record);
+  }
+  FrameHeader header{};
+  std::memcpy(header.magic, frameMagic, sizeof(frameMagic));
+  header.version = frameVersion;
+  header.idBytes = sizeof(Id);
+  header.kind = kind;
+  header.flags = compressed ? tilesCompressed : 0;
+  header.frame = frame;
+  header.gridWidth = grid.getWidth();
+  header.gridHeight = grid.getHeight();
+  header.playerCount = playerRecords.size();
+  header.namesSize = names.size();
+  if (kind == cycles::protocol::keyframe) {
+    tileIndices.clear();
+    grid.forEachTile([&](sf::Vector2i origin, const cycles::TiledGrid::Tile &) {
+      tileIndices.push_back(origin.y / cycles::TiledGrid::tileSize *
+                                grid.getTilesPerRow() +
+                            origin.x / cycles::TiledGrid::tileSize);
+    });
+    header.tileCount = tileIndices.size();
+    if (compressed) {
+      tileEnds.clear();
+      compressedTiles.clear();
+      grid.forEachTile(
+          [&](sf::Vector2i, const cycles::TiledGrid::Tile &tile) {
+            cycles::compressTile(tile, compressedTiles);
+            tileEnds.push_back(compressedTiles.size());
+          });
+    }
+  } else {
+    cellRecords.clear();
+    for (const auto &change : changes) {
+      cellRecords.push_back({static_cast<std::uint32_t>(change.cell),
+                             change.id, 0});
+    }
+    header.changeCount = cellRecords.size();
+  }
+  packet.append(&header, sizeof(header));
+  packet.append(playerRecords.data(),
+                playerRecords.size() * sizeof(PlayerRecord));
+  packet.append(names.data(), names.size());
+  if (kind == cycles::protocol::keyframe) {
+    packet.append(tileIndices.data(),
+                  tileIndices.size() * sizeof(std::uint32_t));
+    if (compressed) {
+      packet.append(tileEnds.data(), tileEnds.size() * sizeof(std::uint32_t));
+      packet.append(compressedTiles.data(), compressedTiles.size());
+    } else {
+      grid.forEachTile(
+          [&](sf::Vector2i, const cycles::TiledGrid::Tile &tile) {
+            packet.append(tile.cells.data(), sizeof(tile.cells));
+          });
+    }
+  } else {
+    packet.append(cellRecords.data(), cellRecords.size() * sizeof(CellRecord));
+  }
+}
+
+void StateEncoder::encode(Game &game, int frame, int kinds) {
+  game.takeChanges(changes);
+  fullState.clear();
+  keyframeState.clear();
+  compressedKeyframeState.clear();
+  deltaState.clear();
+  if (kinds & full) {
+    writeFullState(fullState, game, frame);
+  }
+  if (kinds & keyframe) {
+    writeFrame(keyframeState, game, frame, cycles::protocol::keyframe);
+  }
+  if (kinds & compressedKeyframe) {
+    writeFrame(compressedKeyframeState, game, frame,
+               cycles::protocol::keyframe, true);
+  }
+  if (kinds & delta) {
+    writeFrame(deltaState, game, frame, cycles::protocol::delta);
+  }
+  previousIds = game.getPlayers().getIds();
+}
+
+} // namespace cycles_server
@@ -0,0 +1,60 @@
+#pragma once
+#include "game_logic.h"
+#include <SFML/Network.hpp>
+#include <string>
+#include <vector>
+
+namespace cycles_server {
+
+// Builds the game state packets of a frame once, to send them to every client
+// (see protocol.h for their layout). Full states are for clients that did not
+// ask for deltas, keyframes and deltas for those that did. The packets and
+// the scratch buffers are reused from frame to frame.
+class StateEncoder {
+  std::vector<CellChange> changes;
+  std::vector<Id> previousIds; // Players in the states of the previous frame
+  std::vector<cycles::protocol::PlayerRecord> playerRecords;
+  std::string names;
+  std::vector<std::uint32_t> tileIndices;
+  std::vector<std::uint32_t> tileEnds;
+  std::vector<char> compressedTiles;
+  std::vector<cycles::protocol::CellRecord> cellRecords;
+
+  void writeFullState(sf::Packet &packet, Game &game, int frame);
+  void writeFrame(sf::Packet &packet, Game &game, int frame,
+                  cycles::protocol::StateKind kind, bool compressed = false);
+
+public:
+  // Kinds of states, combined in the argument of encode
+  enum Kind {
+    full = 1 << 0,
+    keyframe = 1 << 1,
+    compressedKeyframe = 1 << 2,
+    delta = 1 << 3,
+  };
+
+  sf::Packet fullState;
+  sf::Packet keyframeState;
+  sf::Packet compressedKeyframeState;
+  sf::Packet deltaState; // Only valid for clients that got the previous frame
+
+  // Encodes the kinds of states requested for the current state of game. The
+  // changes of the game are taken every time, the game must track them (see
+  // Game::trackChanges) and encode must be called once per frame.
+  void encode(Game &game, int frame, int kinds);
+
+  sf::Packet &getPacket(Kind kind) {
+    switch (kind) {
+    case full:
+      return fullState;
+    case keyframe:
+      return keyframeState;
+    case compressedKeyframe:
+      return compressedKeyframeState;
+    default:
+      return deltaState;
+    }
+  }
+};
+
+} // namespace cycles_server
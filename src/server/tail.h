@@ -0,0 +1,103 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+namespace cycles_server {
+
+// Contiguous circular buffer holding the trail of a player.
+// The most recent cell is at the front and the oldest one at the back.
+// Storage only grows (by reserve or when full), so a tail that has reached its
+// capacity moves without touching the allocator.
+class Tail {
+  std::vector<sf::Vector2i> cells;
+  std::size_t head = 0;
+  std::size_t count = 0;
+
+  std::size_t wrap(std::size_t index) const {
+    return index >= cells.size() ? index - cells.size() : index;
+  }
+
+public:
+  class const_iterator {
+    const Tail *tail = nullptr;
+    std::size_t index = 0;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = sf::Vector2i;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const sf::Vector2i *;
+    using reference = const sf::Vector2i &;
+
+    const_iterator() = default;
+    const_iterator(const Tail *tail, std::size_t index)
+        : tail(tail), index(index) {}
+
+    reference operator*() const { return (*tail)[index]; }
+    pointer operator->() const { return &(*tail)[index]; }
+    const_iterator &operator++() {
+      ++index;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto copy = *this;
+      ++index;
+      return copy;
+    }
+    bool operator==(const const_iterator &other) const {
+      return index == other.index;
+    }
+  };
+
+  std::size_t size() const { return count; }
+
+  bool empty() const { return count == 0; }
+
+  std::size_t capacity() const { return cells.size(); }
+
+  // Grows the storage so that at least newCapacity cells fit, keeping order
+  void reserve(std::size_t newCapacity) {
+    if (newCapacity <= cells.size()) {
+      return;
+    }
+    std::vector<sf::Vector2i> grown(newCapacity);
+    for (std::size_t i = 0; i < count; ++i) {
+      grown[i] = (*this)[i];
+    }
+    cells.swap(grown);
+    head = 0;
+  }
+
+  // Element i counting from the front (most recent cell)
+  const sf::Vector2i &operator[](std::size_t i) const {
+    return cells[wrap(head + i)];
+  }
+
+  const sf::Vector2i &front() const { return cells[head]; }
+
+  const sf::Vector2i &back() const { return (*this)[count - 1]; }
+
+  void push_front(sf::Vector2i cell) {
+    if (count == cells.size()) {
+      reserve(cells.empty() ? 64 : 2 * cells.size());
+    }
+    head = head == 0 ? cells.size() - 1 : head - 1;
+    cells[head] = cell;
+    count++;
+  }
+
+  void pop_back() { count--; }
+
+  void clear() {
+    head = 0;
+    count = 0;
+  }
+
+  const_iterator begin() const { return {this, 0}; }
+
+  const_iterator end() const { return {this, count}; }
+};
+
+} // namespace cycles_server
@@ -0,0 +1,54 @@
+#pragma once
+#include <chrono>
+#include <thread>
+
+namespace cycles_server {
+
+// Paces a loop at a fixed number of ticks per second by sleeping until the
+// start of the next tick. Small delays are absorbed, the schedule stays
+// anchored to the first tick so the rate does not drift. A tick that runs past
+// the start of the following one is an overrun: the ticks it covered are
+// skipped instead of being run back to back to catch up, and the schedule
+// restarts from the moment the overrun is noticed.
+class TickScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  Clock::duration period;
+  Clock::time_point nextTick;
+  long overruns = 0;
+
+public:
+  explicit TickScheduler(int ticksPerSecond)
+      : period(std::chrono::duration_cast<Clock::duration>(
+                   std::chrono::seconds(1)) /
+               ticksPerSecond),
+        nextTick(Clock::now()) {}
+
+  // Sleeps until the next tick is due. Returns the number of ticks skipped
+  // because the previous one overran (0 if it ended in time).
+  int waitForTick() {
+    const auto now = Clock::now();
+    int skipped = 0;
+    if (now < nextTick) {
+      std::this_thread::sleep_until(nextTick);
+    } else if (now - nextTick >= period) {
+      skipped = static_cast<int>((now - nextTick) / period);
+      overruns++;
+      nextTick = now;
+    }
+    nextTick += period;
+    return skipped;
+  }
+
+  // End of the budget of the current tick, the start of the next one
+  Clock::time_point getDeadline() const { return nextTick; }
+
+  Clock::duration getPeriod() const { return period; }
+
+  // Number of ticks that overran so far
+  long getOverruns() const { return overruns; }
+};
+
+} // namespace cycles_server
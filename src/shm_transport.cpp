@@ -0,0 +1,296 @@
+#include "shm_transport.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace cycles::shm {
+
+namespace {
+
+constexpr std::uint64_t align(std::uint64_t size) { return (size + 7) & ~7ull; }
+
+// Size of the header and the move slots, the ring starts right after
+std::size_t ringOffset(std::uint32_t moveSlots) {
+  return align(sizeof(SegmentHeader) + moveSlots * sizeof(MoveSlot));
+}
+
+void wake(std::atomic<std::uint32_t> &word) {
+#ifdef __linux__
+  // Not FUTEX_PRIVATE_FLAG, the waiters are in other processes
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE,
+          INT_MAX, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+// Waits until word is no longer expected, or timeout. May wake up early.
+void waitForChange(std::atomic<std::uint32_t> &word, std::uint32_t expected,
+                   sf::Time timeout) {
+#ifdef __linux__
+  const auto micros = timeout.asMicroseconds();
+  timespec time{static_cast<time_t>(micros / 1000000),
+                static_cast<long>(micros % 1000000) * 1000};
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT,
+          expected, &time, nullptr, 0);
+#else
+  (void)word;
+  (void)expected;
+  std::this_thread::sleep_for(std::chrono::microseconds(
+      std::min<std::int64_t>(timeout.asMicroseconds(), 100)));
+#endif
+}
+
+} // namespace
+
+#ifdef _WIN32
+
+std::unique_ptr<Segment> Segment::create(const std::string &, std::uint32_t,
+                                         std::uint32_t, std::uint64_t) {
+  throw std::runtime_error("Shared memory is not supported on this platform");
+}
+
+std::unique_ptr<Segment> Segment::open(const std::string &) {
+  throw std::runtime_error("Shared memory is not supported on this platform");
+}
+
+Segment::~Segment() {}
+
+#else
+
+std::unique_ptr<Segment> Segment::create(const std::string &name,
+                                         std::uint32_t idBytes,
+                                         std::uint32_t moveSlots,
+                                         std::uint64_t ringSize) {
+  if (ringSize % 8 != 0) {
+    throw std::runtime_error("The size of the ring must be a multiple of 8");
+  }
+  shm_unlink(name.c_str());
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to create shared memory " + name + ": " +
+                             std::strerror(errno));
+  }
+  std::unique_ptr<Segment> segment(new Segment());
+  segment->name = name;
+  segment->owner = true;
+  segment->size = ringOffset(moveSlots) + ringSize;
+  if (ftruncate(fd, segment->size) != 0) {
+    close(fd);
+    throw std::runtime_error("Failed to size shared memory " + name + ": " +
+                             std::strerror(errno));
+  }
+  segment->memory = mmap(nullptr, segment->size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment->memory == MAP_FAILED) {
+    segment->memory = nullptr;
+    throw std::runtime_error("Failed to map shared memory " + name + ": " +
+                             std::strerror(errno));
+  }
+  // The new pages are zeroed, which is a valid state for all the atomics
+  auto *header = new (segment->memory) SegmentHeader();
+  header->version = segmentVersion;
+  header->idBytes = idBytes;
+  header->moveSlots = moveSlots;
+  header->ringSize = ringSize;
+  // The magic is written last, clients check it before anything else
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header->magic, segmentMagic, sizeof(segmentMagic));
+  return segment;
+}
+
+std::unique_ptr<Segment> Segment::open(const std::string &name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open shared memory " + name + ": " +
+                             std::strerror(errno));
+  }
+  const auto size = lseek(fd, 0, SEEK_END);
+  if (size < static_cast<off_t>(sizeof(SegmentHeader))) {
+    close(fd);
+    throw std::runtime_error("Shared memory " + name + " is too small");
+  }
+  std::unique_ptr<Segment> segment(new Segment());
+  segment->name = name;
+  segment->size = size;
+  segment->memory =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment->memory == MAP_FAILED) {
+    segment->memory = nullptr;
+    throw std::runtime_error("Failed to map shared memory " + name + ": " +
+                             std::strerror(errno));
+  }
+  const auto &header = segment->header();
+  if (std::memcmp(header.magic, segmentMagic, sizeof(segmentMagic)) != 0 ||
+      header.version != segmentVersion ||
+      ringOffset(header.moveSlots) + header.ringSize != segment->size) {
+    throw std::runtime_error("Shared memory " + name +
+                             " was not created by this version of the game");
+  }
+  return segment;
+}
+
+Segment::~Segment() {
+  if (memory != nullptr) {
+    munmap(memory, size);
+  }
+  if (owner) {
+    shm_unlink(name.c_str());
+  }
+}
+
+#endif
+
+MoveSlot &Segment::moveSlot(std::uint32_t index) {
+  auto *slots = reinterpret_cast<MoveSlot *>(static_cast<char *>(memory) +
+                                             sizeof(SegmentHeader));
+  return slots[index];
+}
+
+char *Segment::ring() {
+  return static_cast<char *>(memory) + ringOffset(header().moveSlots);
+}
+
+void writeFrame(Segment &segment, const void *data, std::size_t size) {
+  auto &header = segment.header();
+  const auto ringSize = header.ringSize;
+  const auto recordSize = align(sizeof(RecordHeader) + size);
+  if (recordSize > ringSize / 2) {
+    throw std::runtime_error("Frame too large for the shared memory ring");
+  }
+  // There is a single writer, nobody else moves the positions
+  auto position = header.published.load(std::memory_order_relaxed);
+  const auto offset = position % ringSize;
+  const auto padding = offset + recordSize > ringSize ? ringSize - offset : 0;
+  // Readers check reserved after copying a frame, to know if it was being
+  // overwritten meanwhile
+  header.reserved.store(position + padding + recordSize,
+                        std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  auto *ring = segment.ring();
+  if (padding > 0) {
+    const RecordHeader pad{0, 1};
+    std::memcpy(ring + offset, &pad, sizeof(pad));
+    position += padding;
+  }
+  const RecordHeader record{static_cast<std::uint32_t>(size), 0};
+  std::memcpy(ring + position % ringSize, &record, sizeof(record));
+  std::memcpy(ring + position % ringSize + sizeof(record), data, size);
+  header.published.store(position + recordSize, std::memory_order_release);
+  header.frameCount.fetch_add(1, std::memory_order_release);
+  wake(header.frameCount);
+}
+
+FrameReader::FrameReader(Segment &segment)
+    : segment(&segment),
+      position(segment.header().published.load(std::memory_order_acquire)),
+      frameCount(segment.header().frameCount.load(std::memory_order_acquire)) {
+}
+
+FrameReader::Status FrameReader::read(std::vector<char> &buffer) {
+  auto &header = segment->header();
+  const auto ringSize = header.ringSize;
+  const auto *ring = segment->ring();
+  // Frames overwritten while they were copied are detected afterwards
+  auto overwritten = [&] {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header.reserved.load(std::memory_order_relaxed) >
+           position + ringSize;
+  };
+  auto skipLost = [&] {
+    position = header.published.load(std::memory_order_acquire);
+    return lost;
+  };
+  while (true) {
+    const auto published = header.published.load(std::memory_order_acquire);
+    if (position == published) {
+      return empty;
+    }
+    if (published - position > ringSize) {
+      return skipLost();
+    }
+    const auto offset = position % ringSize;
+    RecordHeader record;
+    std::memcpy(&record, ring + offset, sizeof(record));
+    if (overwritten()) {
+      return skipLost();
+    }
+    if (record.padding) {
+      position += ringSize - offset;
+      continue;
+    }
+    const auto recordSize = align(sizeof(RecordHeader) + record.size);
+    if (offset + recordSize > ringSize) {
+      return skipLost();
+    }
+    buffer.resize(record.size);
+    std::memcpy(buffer.data(), ring + offset + sizeof(record), record.size);
+    if (overwritten()) {
+      return skipLost();
+    }
+    position += recordSize;
+    return frame;
+  }
+}
+
+bool FrameReader::wait(sf::Time timeout) {
+  auto &header = segment->header();
+  sf::Clock clock;
+  while (true) {
+    if (header.published.load(std::memory_order_acquire) != position) {
+      return true;
+    }
+    const auto remaining = timeout - clock.getElapsedTime();
+    if (remaining <= sf::Time::Zero) {
+      return false;
+    }
+    // Waiting on the value read before checking the position, so that a
+    // frame written in between is not missed
+    waitForChange(header.frameCount, frameCount, remaining);
+    frameCount = header.frameCount.load(std::memory_order_acquire);
+  }
+}
+
+void writeMove(MoveSlot &slot, int frame, int direction) {
+  const auto sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.frame.store(frame, std::memory_order_relaxed);
+  slot.direction.store(direction, std::memory_order_relaxed);
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool readMove(const MoveSlot &slot, std::uint32_t &lastSequence, Move &move) {
+  const auto before = slot.sequence.load(std::memory_order_acquire);
+  if (before == lastSequence || before % 2 == 1) {
+    return false;
+  }
+  const Move read{slot.frame.load(std::memory_order_relaxed),
+                  slot.direction.load(std::memory_order_relaxed)};
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.sequence.load(std::memory_order_relaxed) != before) {
+    return false;
+  }
+  lastSequence = before;
+  move = read;
+  return true;
+}
+
+} // namespace cycles::shm
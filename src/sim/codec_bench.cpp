@@ -0,0 +1,116 @@
+#include "server/state_encoder.h"
+#include "simulation.h"
+#include "tile_codec.h"
+#include "utils.h"
+#include <SFML/System.hpp>
+#include <array>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <string>
+
+using namespace cycles_sim;
+
+// Turns at random, only into empty cells, to leave trails like real players
+class WanderBot : public Bot {
+  std::mt19937 rng;
+  int direction = 0;
+
+public:
+  WanderBot(unsigned int seed) : rng(seed) {}
+
+  Direction decideMove(const GameState &state, Id playerId) override {
+    sf::Vector2i position;
+    for (const auto &player : state.players) {
+      if (player.id == playerId) {
+        position = player.position;
+        break;
+      }
+    }
+    if (std::uniform_int_distribution<int>(0, 19)(rng) == 0) {
+      direction = std::uniform_int_distribution<int>(0, 3)(rng);
+    }
+    for (int turn = 0; turn < 4; turn++) {
+      const auto candidate = cycles::getDirectionFromValue((direction + turn) % 4);
+      const auto next = position + cycles::getDirectionVector(candidate);
+      if (state.isInsideGrid(next) && state.isCellEmpty(next)) {
+        direction = (direction + turn) % 4;
+        break;
+      }
+    }
+    return cycles::getDirectionFromValue(direction);
+  }
+};
+
+// Measures the size of keyframes with and without compressed tiles and the
+// time spent compressing and decompressing them, on grids filled by bots
+int main(int argc, char *argv[]) {
+  if (argc > 4) {
+    spdlog::error("Usage: {} [config_file] [bots] [frames]", argv[0]);
+    return 1;
+  }
+  const std::string config_path = argc > 1 ? argv[1] : "config.yaml";
+  const cycles_server::Configuration conf(config_path);
+  const int numBots = argc > 2 ? std::stoi(argv[2]) : conf.maxClients;
+  const int numFrames = argc > 3 ? std::stoi(argv[3]) : 1000;
+  constexpr int repetitions = 20;
+
+  Simulation simulation(conf);
+  std::random_device rd;
+  for (int i = 0; i < numBots; i++) {
+    simulation.addBot("wanderer" + std::to_string(i),
+                      std::make_unique<WanderBot>(rd()));
+  }
+  for (int frame = 0; frame < numFrames && simulation.step(); frame++) {
+  }
+  auto &game = simulation.getGame();
+  const auto &grid = game.getGrid();
+
+  std::vector<char> compressed;
+  sf::Clock clock;
+  for (int i = 0; i < repetitions; i++) {
+    compressed.clear();
+    grid.forEachTile([&](sf::Vector2i, const cycles::TiledGrid::Tile &tile) {
+      cycles::compressTile(tile, compressed);
+    });
+  }
+  const auto compressTime = clock.getElapsedTime().asMicroseconds() / repetitions;
+
+  // Decompress the tiles back to back, the ends are needed to split them
+  std::vector<std::size_t> ends;
+  compressed.clear();
+  grid.forEachTile([&](sf::Vector2i, const cycles::TiledGrid::Tile &tile) {
+    cycles::compressTile(tile, compressed);
+    ends.push_back(compressed.size());
+  });
+  std::array<Id, cycles::TiledGrid::tileSize * cycles::TiledGrid::tileSize>
+      cells;
+  clock.restart();
+  for (int i = 0; i < repetitions; i++) {
+    std::size_t begin = 0;
+    for (auto end : ends) {
+      if (!cycles::decompressTile(compressed.data() + begin, end - begin,
+                                  cells.data())) {
+        spdlog::critical("Failed to decompress a tile");
+        exit(1);
+      }
+      begin = end;
+    }
+  }
+  const auto decompressTime =
+      clock.getElapsedTime().asMicroseconds() / repetitions;
+
+  cycles_server::StateEncoder encoder;
+  game.trackChanges();
+  encoder.encode(game, simulation.getFrame(),
+                 cycles_server::StateEncoder::keyframe |
+                     cycles_server::StateEncoder::compressedKeyframe);
+  spdlog::info("{} frames, {} tiles of {} cells", simulation.getFrame(),
+               grid.getTileCount(),
+               cycles::TiledGrid::tileSize * cycles::TiledGrid::tileSize);
+  spdlog::info("Keyframe: {} bytes raw, {} bytes compressed",
+               encoder.keyframeState.getDataSize(),
+               encoder.compressedKeyframeState.getDataSize());
+  spdlog::info("Tiles: compressed in {} us, decompressed in {} us",
+               compressTime, decompressTime);
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "simulation.h"
+#include "utils.h"
+#include <SFML/System.hpp>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <string>
+
+using namespace cycles_sim;
+
+// Same strategy as the example client: random moves with some inertia
+class RandomBot : public Bot {
+  std::mt19937 rng;
+  int previousDirection = -1;
+  int inertia;
+
+public:
+  RandomBot(unsigned int seed) : rng(seed) {
+    inertia = std::uniform_int_distribution<int>(0, 50)(rng);
+  }
+
+  Direction decideMove(const GameState &state, Id playerId) override {
+    sf::Vector2i position;
+    for (const auto &player : state.players) {
+      if (player.id == playerId) {
+        position = player.position;
+        break;
+      }
+    }
+    auto isValidMove = [&](Direction direction) {
+      auto newPos = position + cycles::getDirectionVector(direction);
+      return state.isInsideGrid(newPos) && state.isCellEmpty(newPos);
+    };
+    std::uniform_int_distribution<int> dist(0, 3 + inertia);
+    constexpr int max_attempts = 200;
+    Direction direction = Direction::north;
+    for (int attempts = 0; attempts < max_attempts; attempts++) {
+      int proposal = dist(rng);
+      if (proposal > 3) {
+        proposal = previousDirection < 0 ? proposal % 4 : previousDirection;
+      }
+      direction = cycles::getDirectionFromValue(proposal);
+      if (isValidMove(direction)) {
+        break;
+      }
+    }
+    previousDirection = cycles::getDirectionValue(direction);
+    return direction;
+  }
+};
+
+int main(int argc, char *argv[]) {
+#if SPDLOG_ACTIVE_LEVEL == SPDLOG_LEVEL_TRACE
+  spdlog::set_level(spdlog::level::debug);
+#endif
+  if (argc > 4) {
+    spdlog::error("Usage: {} [config_file] [bots] [matches]", argv[0]);
+    return 1;
+  }
+  const std::string config_path = argc > 1 ? argv[1] : "config.yaml";
+  const cycles_server::Configuration conf(config_path);
+  const int numBots = argc > 2 ? std::stoi(argv[2]) : conf.maxClients;
+  const int numMatches = argc > 3 ? std::stoi(argv[3]) : 1;
+  constexpr int maxFrames = 1000000;
+  std::random_device rd;
+  long totalFrames = 0;
+  sf::Clock clock;
+  for (int match = 0; match < numMatches; match++) {
+    Simulation simulation(conf);
+    for (int i = 0; i < numBots; i++) {
+      simulation.addBot("randomio" + std::to_string(i),
+                        std::make_unique<RandomBot>(rd()));
+    }
+    auto result = simulation.run(maxFrames);
+    totalFrames += result.frames;
+    spdlog::info("Match {}: {} frames, winner: {}", match, result.frames,
+                 result.survivors.empty() ? "none" : result.survivors.front());
+  }
+  const float elapsed = clock.getElapsedTime().asSeconds();
+  spdlog::info("Simulated {} frames in {:.3f} s ({:.0f} frames/s)", totalFrames,
+               elapsed, totalFrames / elapsed);
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include "simulation.h"
+#include <spdlog/spdlog.h>
+
+namespace cycles_sim {
+
+Simulation::Simulation(cycles_server::Configuration conf) : game(conf) {
+  state.gridWidth = conf.gridWidth;
+  state.gridHeight = conf.gridHeight;
+}
+
+Id Simulation::addBot(const std::string &name, std::unique_ptr<Bot> bot) {
+  auto id = game.addPlayer(name);
+  if (id != 0) {
+    bots[id] = std::move(bot);
+  }
+  return id;
+}
+
+void Simulation::updateState() {
+  state.grid = game.getGrid();
+  state.occupied = cycles::Bitboard(state.gridWidth, state.gridHeight);
+  state.grid.forEachCell(
+      [&](sf::Vector2i cell, Id) { state.occupied.set(cell); });
+  const auto &players = game.getPlayers();
+  state.players.resize(players.size());
+  auto statePlayer = state.players.begin();
+  for (const auto &player : players) {
+    statePlayer->name = player.name;
+    statePlayer->color = player.color;
+    statePlayer->position = player.position;
+    statePlayer->id = player.id;
+    ++statePlayer;
+  }
+  state.frameNumber = frame;
+}
+
+bool Simulation::step() {
+  if (game.isGameOver()) {
+    return false;
+  }
+  game.setFrame(frame);
+  updateState();
+  directions.clear();
+  // Bots outlive their players, but only the living ones are asked to move
+  for (const auto &[id, bot] : bots) {
+    if (game.getPlayers().contains(id)) {
+      directions[id] = bot->decideMove(state, id);
+    }
+  }
+  game.movePlayers(directions);
+  frame++;
+  return !game.isGameOver();
+}
+
+MatchResult Simulation::run(int maxFrames) {
+  while (frame < maxFrames && step()) {
+  }
+  MatchResult result;
+  result.frames = frame;
+  for (const auto &player : game.getPlayers()) {
+    result.survivors.push_back(player.name);
+  }
+  spdlog::debug("Simulation: match finished after {} frames with {} survivors",
+                result.frames, result.survivors.size());
+  return result;
+}
+
+} // namespace cycles_sim
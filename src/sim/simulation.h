@@ -0,0 +1,60 @@
+#pragma once
+#include "api.h"
+#include "server/game_logic.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cycles_sim {
+using cycles::Direction;
+using cycles::GameState;
+using cycles::Id;
+
+// A bot that plays inside the simulation process, without a Connection
+class Bot {
+public:
+  virtual ~Bot() = default;
+
+  // Called once per frame with the current state of the game, must return the
+  // move of the player with id playerId. The state is shared by all the bots
+  // and is only valid during the call.
+  virtual Direction decideMove(const GameState &state, Id playerId) = 0;
+};
+
+struct MatchResult {
+  int frames = 0;
+  std::vector<std::string> survivors; // Names of the players alive at the end
+};
+
+// Runs a match fully in process on top of cycles_server::Game.
+// Frames are stepped back to back as fast as the bots can decide, there are no
+// sockets, no window and no tick pacing.
+class Simulation {
+  cycles_server::Game game;
+  std::map<Id, std::unique_ptr<Bot>> bots;
+  std::map<Id, Direction> directions;
+  GameState state;
+  int frame = 0;
+
+  void updateState();
+
+public:
+  Simulation(cycles_server::Configuration conf);
+
+  // Adds a player controlled by bot, returns its id or 0 if the grid is full
+  Id addBot(const std::string &name, std::unique_ptr<Bot> bot);
+
+  // Asks every living bot for a move and advances the game one frame.
+  // Returns false once the game is over.
+  bool step();
+
+  // Steps until the game is over or maxFrames frames have been played
+  MatchResult run(int maxFrames);
+
+  int getFrame() const { return frame; }
+
+  cycles_server::Game &getGame() { return game; }
+};
+
+} // namespace cycles_sim
@@ -0,0 +1,85 @@
+#include "tile_codec.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace cycles {
+
+namespace {
+
+constexpr int tileCells = TiledGrid::tileSize * TiledGrid::tileSize;
+
+void writeRun(std::vector<char> &out, int length, Id id) {
+  unsigned value = length - 1;
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+  const auto begin = out.size();
+  out.resize(begin + sizeof(Id));
+  std::memcpy(&out[begin], &id, sizeof(Id));
+}
+
+} // namespace
+
+void compressTile(const TiledGrid::Tile &tile, std::vector<char> &out) {
+  constexpr int size = TiledGrid::tileSize;
+  Id runId = 0;
+  int runLength = 0;
+  auto extend = [&](int length, Id id) {
+    if (id != runId && runLength > 0) {
+      writeRun(out, runLength, runId);
+      runLength = 0;
+    }
+    runId = id;
+    runLength += length;
+  };
+  for (int y = 0; y < size; ++y) {
+    auto bits = tile.rows[y];
+    int x = 0;
+    while (bits) {
+      const int next = std::countr_zero(bits);
+      if (next > x) {
+        extend(next - x, 0);
+      }
+      extend(1, tile.cells[y * size + next]);
+      x = next + 1;
+      bits &= bits - 1;
+    }
+    if (x < size) {
+      extend(size - x, 0);
+    }
+  }
+  writeRun(out, runLength, runId);
+}
+
+bool decompressTile(const char *data, std::size_t size, Id *cells) {
+  std::size_t position = 0;
+  int filled = 0;
+  while (position < size) {
+    unsigned length = 0;
+    for (int shift = 0;; shift += 7) {
+      if (position >= size || shift > 14) {
+        return false;
+      }
+      const auto byte = static_cast<unsigned char>(data[position++]);
+      length |= unsigned(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        break;
+      }
+    }
+    length += 1;
+    if (position + sizeof(Id) > size || filled + length > tileCells) {
+      return false;
+    }
+    Id id;
+    std::memcpy(&id, data + position, sizeof(Id));
+    position += sizeof(Id);
+    std::fill_n(cells + filled, length, id);
+    filled += length;
+  }
+  return filled == tileCells;
+}
+
+} // namespace cycles
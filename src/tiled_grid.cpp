@@ -0,0 +1,189 @@
+#include "tiled_grid.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace cycles {
+
+TiledGrid::TiledGrid(int width, int height)
+    : width(width), height(height),
+      tilesPerRow((width + tileSize - 1) / tileSize),
+      tiles(tilesPerRow * ((height + tileSize - 1) / tileSize)) {}
+
+TiledGrid::TiledGrid(const TiledGrid &other)
+    : width(other.width), height(other.height), tilesPerRow(other.tilesPerRow),
+      tiles(other.tiles.size()) {
+  *this = other;
+}
+
+TiledGrid &TiledGrid::operator=(const TiledGrid &other) {
+  if (this == &other) {
+    return *this;
+  }
+  if (tiles.size() != other.tiles.size()) {
+    clear();
+    tiles.resize(other.tiles.size());
+  }
+  width = other.width;
+  height = other.height;
+  tilesPerRow = other.tilesPerRow;
+  // Reuse the tiles already allocated, only the occupied ones are copied
+  for (std::size_t index = 0; index < tiles.size(); ++index) {
+    if (!other.tiles[index]) {
+      releaseTile(index);
+      continue;
+    }
+    if (!tiles[index]) {
+      tiles[index] = newTile();
+      tileCount++;
+    }
+    *tiles[index] = *other.tiles[index];
+  }
+  return *this;
+}
+
+std::unique_ptr<TiledGrid::Tile> TiledGrid::newTile() {
+  if (spare.empty()) {
+    return std::make_unique<Tile>();
+  }
+  auto tile = std::move(spare.back());
+  spare.pop_back();
+  return tile;
+}
+
+void TiledGrid::releaseTile(int index) {
+  auto &tile = tiles[index];
+  if (!tile) {
+    return;
+  }
+  // Tiles are only released once all their cells are back to 0, unless the
+  // whole grid is cleared
+  if (tile->occupied > 0) {
+    *tile = Tile();
+  }
+  spare.push_back(std::move(tile));
+  tileCount--;
+}
+
+void TiledGrid::set(int x, int y, Id id) {
+  const int index = tileIndex(x, y);
+  auto &tile = tiles[index];
+  if (!tile) {
+    if (id == 0) {
+      return;
+    }
+    tile = newTile();
+    tileCount++;
+  }
+  const int cx = x % tileSize;
+  const int cy = y % tileSize;
+  auto &cell = tile->cells[cy * tileSize + cx];
+  const std::uint64_t mask = std::uint64_t(1) << cx;
+  if (cell == 0 && id != 0) {
+    tile->rows[cy] |= mask;
+    tile->occupied++;
+  } else if (cell != 0 && id == 0) {
+    tile->rows[cy] &= ~mask;
+    tile->occupied--;
+  }
+  cell = id;
+  if (tile->occupied == 0) {
+    releaseTile(index);
+  }
+}
+
+void TiledGrid::setTile(int index, const void *cells) {
+  auto &tile = tiles[index];
+  if (!tile) {
+    tile = newTile();
+    tileCount++;
+  }
+  std::memcpy(tile->cells.data(), cells, sizeof(tile->cells));
+  tile->occupied = 0;
+  for (int y = 0; y < tileSize; ++y) {
+    const auto *row = &tile->cells[y * tileSize];
+    std::uint64_t bits = 0;
+    for (int x = 0; x < tileSize; ++x) {
+      bits |= std::uint64_t(row[x] != 0) << x;
+    }
+    tile->rows[y] = bits;
+    tile->occupied += std::popcount(bits);
+  }
+  if (tile->occupied == 0) {
+    releaseTile(index);
+  }
+}
+
+void TiledGrid::clear() {
+  for (std::size_t index = 0; index < tiles.size(); ++index) {
+    releaseTile(index);
+  }
+}
+
+bool TiledGrid::operator==(const TiledGrid &other) const {
+  if (width != other.width || height != other.height ||
+      tileCount != other.tileCount) {
+    return false;
+  }
+  for (std::size_t index = 0; index < tiles.size(); ++index) {
+    const auto &a = tiles[index];
+    const auto &b = other.tiles[index];
+    if (bool(a) != bool(b) || (a && (a->cells != b->cells))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+sf::Packet &operator<<(sf::Packet &packet, const TiledGrid &grid) {
+  packet << static_cast<sf::Uint32>(grid.getTileCount());
+  const int tilesPerRow =
+      (grid.getWidth() + TiledGrid::tileSize - 1) / TiledGrid::tileSize;
+  grid.forEachTile([&](sf::Vector2i origin, const TiledGrid::Tile &tile) {
+    const auto index = origin.y / TiledGrid::tileSize * tilesPerRow +
+                       origin.x / TiledGrid::tileSize;
+    packet << static_cast<sf::Uint32>(index)
+           << static_cast<sf::Uint16>(tile.occupied);
+    for (int y = 0; y < TiledGrid::tileSize; ++y) {
+      for (auto bits = tile.rows[y]; bits; bits &= bits - 1) {
+        const int offset = y * TiledGrid::tileSize + std::countr_zero(bits);
+        packet << static_cast<sf::Uint16>(offset) << tile.cells[offset];
+      }
+    }
+  });
+  return packet;
+}
+
+sf::Packet &operator>>(sf::Packet &packet, TiledGrid &grid) {
+  grid.clear();
+  const int tilesPerRow =
+      (grid.getWidth() + TiledGrid::tileSize - 1) / TiledGrid::tileSize;
+  const int tilesPerColumn =
+      (grid.getHeight() + TiledGrid::tileSize - 1) / TiledGrid::tileSize;
+  sf::Uint32 tileCount = 0;
+  packet >> tileCount;
+  for (sf::Uint32 i = 0; i < tileCount && packet; ++i) {
+    sf::Uint32 index = 0;
+    sf::Uint16 occupied = 0;
+    packet >> index >> occupied;
+    if (static_cast<int>(index) >= tilesPerRow * tilesPerColumn) {
+      throw std::runtime_error("Grid tile out of range");
+    }
+    const sf::Vector2i origin(index % tilesPerRow * TiledGrid::tileSize,
+                              index / tilesPerRow * TiledGrid::tileSize);
+    for (int j = 0; j < occupied && packet; ++j) {
+      sf::Uint16 offset = 0;
+      Id id = 0;
+      packet >> offset >> id;
+      const int x = origin.x + offset % TiledGrid::tileSize;
+      const int y = origin.y + offset / TiledGrid::tileSize;
+      if (offset >= TiledGrid::tileSize * TiledGrid::tileSize ||
+          x >= grid.getWidth() || y >= grid.getHeight()) {
+        throw std::runtime_error("Grid cell out of range");
+      }
+      grid.set(x, y, id);
+    }
+  }
+  return packet;
+}
+
+} // namespace cycles
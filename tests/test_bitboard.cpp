@@ -0,0 +1,130 @@
+//GTest tests for the bitboard helpers of the client API
+#include"bitboard.h"
+#include"gtest/gtest.h"
+#include<queue>
+#include<random>
+using namespace cycles;
+
+// A grid 70 cells wide, so rows span two words, with random walls
+std::vector<int> randomGrid(int width, int height, float density, int seed){
+  std::mt19937 rng(seed);
+  std::bernoulli_distribution wall(density);
+  std::vector<int> grid(width * height);
+  for (auto &cell : grid) {
+    cell = wall(rng);
+  }
+  return grid;
+}
+
+// Scalar BFS over the free cells, -1 for unreachable
+std::vector<int> bfs(const std::vector<int> &grid, int width, int height,
+                     std::vector<sf::Vector2i> sources){
+  std::vector<int> distance(width * height, -1);
+  std::queue<sf::Vector2i> queue;
+  for (auto source : sources) {
+    distance[source.y * width + source.x] = 0;
+    queue.push(source);
+  }
+  while (!queue.empty()) {
+    auto cell = queue.front();
+    queue.pop();
+    for (auto step : {sf::Vector2i(1, 0), sf::Vector2i(-1, 0),
+                      sf::Vector2i(0, 1), sf::Vector2i(0, -1)}) {
+      auto next = cell + step;
+      if (next.x < 0 || next.x >= width || next.y < 0 || next.y >= height ||
+          grid[next.y * width + next.x] ||
+          distance[next.y * width + next.x] >= 0) {
+        continue;
+      }
+      distance[next.y * width + next.x] = distance[cell.y * width + cell.x] + 1;
+      queue.push(next);
+    }
+  }
+  return distance;
+}
+
+TEST(BitboardTest, Basics){
+  Bitboard board(70, 3);
+  board.set({69, 2});
+  board.set({0, 1});
+  EXPECT_EQ(board.count(), 2);
+  EXPECT_TRUE(board.contains({69, 2}));
+  EXPECT_FALSE(board.contains({70, 2}));
+  EXPECT_EQ((~board).count(), 70 * 3 - 2);
+  auto grown = board.dilate();
+  EXPECT_EQ(grown.count(), 2 + 2 + 3);
+  EXPECT_TRUE(grown.contains({68, 2}));
+  EXPECT_TRUE(grown.contains({69, 1}));
+  EXPECT_TRUE(grown.contains({1, 1}));
+}
+
+TEST(BitboardTest, FloodFillMatchesBFS){
+  const int width = 70, height = 40;
+  auto grid = randomGrid(width, height, 0.3, 1);
+  const sf::Vector2i start(35, 20);
+  grid[start.y * width + start.x] = 1; // Start on an occupied cell, like a head
+  auto free = ~Bitboard(grid, width, height);
+  auto reached = floodFill(free, start);
+  auto distance = bfs(grid, width, height, {start});
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      bool expected = distance[y * width + x] > 0;
+      ASSERT_EQ(reached.contains({x, y}), expected) << x << "," << y;
+    }
+  }
+}
+
+TEST(BitboardTest, DistanceLayersMatchBFS){
+  const int width = 70, height = 40;
+  auto grid = randomGrid(width, height, 0.25, 2);
+  std::vector<sf::Vector2i> sources = {{3, 3}, {60, 30}};
+  Bitboard sourceBoard(width, height);
+  for (auto source : sources) {
+    sourceBoard.set(source);
+  }
+  auto layers = distanceLayers(~Bitboard(grid, width, height), sourceBoard);
+  auto distance = bfs(grid, width, height, sources);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      for (int d = 0; d < static_cast<int>(layers.size()); d++) {
+        ASSERT_EQ(layers[d].contains({x, y}), distance[y * width + x] == d);
+      }
+    }
+  }
+}
+
+TEST(BitboardTest, VoronoiMatchesBFS){
+  const int width = 70, height = 40;
+  auto grid = randomGrid(width, height, 0.2, 3);
+  std::vector<sf::Vector2i> positions = {{5, 5}, {64, 10}, {30, 35}};
+  for (auto position : positions) {
+    grid[position.y * width + position.x] = 1;
+  }
+  auto counts = voronoiCounts(~Bitboard(grid, width, height), positions);
+  std::vector<std::vector<int>> distances;
+  for (auto position : positions) {
+    distances.push_back(bfs(grid, width, height, {position}));
+  }
+  std::vector<int> expected(positions.size(), 0);
+  for (int cell = 0; cell < width * height; cell++) {
+    int best = -1, owner = -1;
+    bool tie = false;
+    for (int i = 0; i < static_cast<int>(positions.size()); i++) {
+      int d = distances[i][cell];
+      if (d <= 0) {
+        continue;
+      }
+      if (best < 0 || d < best) {
+        best = d;
+        owner = i;
+        tie = false;
+      } else if (d == best) {
+        tie = true;
+      }
+    }
+    if (owner >= 0 && !tie) {
+      expected[owner]++;
+    }
+  }
+  EXPECT_EQ(counts, expected);
+}
@@ -0,0 +1,241 @@
+//GTest tests for the export of frames to images
+#include"server/frame_exporter.h"
+#include"server/game_logic.h"
+#include"gtest/gtest.h"
+#include<cstring>
+#include<stdexcept>
+#include<string>
+#include<vector>
+using cycles::Id;
+using namespace cycles_server;
+
+FrameSnapshot exampleSnapshot(){
+  FrameSnapshot snapshot;
+  snapshot.grid = cycles::TiledGrid(70, 20);
+  for (int x = 5; x < 69; x++) {
+    snapshot.grid.set(x, 3, 2);
+  }
+  snapshot.grid.set(69, 19, 7);
+  snapshot.players.push_back({7, "seven", Game::getPlayerColor(7), {69, 19}, 0, 0});
+  return snapshot;
+}
+
+std::uint32_t readUint32(const std::vector<char> &data, std::size_t offset){
+  std::uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    value = value << 8 | static_cast<std::uint8_t>(data[offset + i]);
+  }
+  return value;
+}
+
+TEST(FrameExporterTest, Ppm){
+  const auto snapshot = exampleSnapshot();
+  FrameExporter exporter(70, 20, 2, FrameExporter::ppm, 3);
+  const auto image = exporter.encode(snapshot);
+  const std::string header = "P6\n140 40\n255\n";
+  ASSERT_EQ(image.size(), header.size() + 140 * 40 * 3);
+  EXPECT_EQ(std::string(image.begin(), image.begin() + header.size()), header);
+  auto pixel = [&](int x, int y) {
+    const auto *data = reinterpret_cast<const std::uint8_t *>(image.data()) +
+                       header.size() + (y * 140 + x) * 3;
+    return sf::Color(data[0], data[1], data[2]);
+  };
+  EXPECT_EQ(pixel(0, 0), sf::Color::Black);
+  const auto trail = Game::getPlayerColor(2);
+  EXPECT_EQ(pixel(10, 6), trail);
+  EXPECT_EQ(pixel(137, 7), trail);
+  EXPECT_EQ(pixel(10, 8), sf::Color::Black);
+  // The head is darker than the trail
+  EXPECT_LT(pixel(139, 39).r + pixel(139, 39).g + pixel(139, 39).b,
+            trail.r + trail.g + trail.b);
+  // Bands do not change the image
+  FrameExporter single(70, 20, 2, FrameExporter::ppm, 1);
+  EXPECT_EQ(single.encode(snapshot), image);
+}
+
+TEST(FrameExporterTest, PngChunks){
+  FrameExporter exporter(70, 20, 3, FrameExporter::png, 4);
+  const auto &image = exporter.encode(exampleSnapshot());
+  ASSERT_GT(image.size(), 8u);
+  EXPECT_EQ(std::memcmp(image.data(), "\x89PNG\r\n\x1a\n", 8), 0);
+  EXPECT_EQ(std::string(image.begin() + 12, image.begin() + 16), "IHDR");
+  EXPECT_EQ(readUint32(image, 16), 210u);
+  EXPECT_EQ(readUint32(image, 20), 60u);
+  // Walk the chunks up to IEND
+  std::size_t offset = 8;
+  std::string last;
+  int dataChunks = 0;
+  while (offset + 12 <= image.size()) {
+    const auto length = readUint32(image, offset);
+    last = std::string(image.begin() + offset + 4, image.begin() + offset + 8);
+    dataChunks += last == "IDAT";
+    offset += 12 + length;
+  }
+  EXPECT_EQ(offset, image.size());
+  EXPECT_EQ(last, "IEND");
+  // The zlib header, one chunk per band and the end of the stream
+  EXPECT_EQ(dataChunks, 6);
+  // Solid rows compress well
+  EXPECT_LT(image.size(), 210u * 60 * 3 / 10);
+}
+
+std::uint32_t crc32(const char *data, std::size_t size){
+  std::uint32_t crc = 0xFFFFFFFFu;
+  for (std::size_t i = 0; i < size; i++) {
+    crc ^= static_cast<std::uint8_t>(data[i]);
+    for (int k = 0; k < 8; k++) {
+      crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+// Inflates the stored and fixed Huffman blocks the exporter writes, fails the
+// test on anything else
+std::vector<std::uint8_t> inflate(const std::vector<std::uint8_t> &stream,
+                                  std::size_t &offset){
+  std::vector<std::uint8_t> out;
+  std::size_t bit = offset * 8;
+  auto read = [&](int count) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < count; i++, bit++) {
+      value |= ((stream.at(bit / 8) >> (bit % 8)) & 1u) << i;
+    }
+    return value;
+  };
+  // Huffman codes are read from their most significant bit
+  auto readSymbol = [&]() -> int {
+    std::uint32_t code = 0;
+    for (int length = 1; length <= 9; length++) {
+      code = code << 1 | read(1);
+      if (length == 7 && code <= 0x17) {
+        return 256 + code;
+      }
+      if (length == 8 && code >= 0x30 && code <= 0xBF) {
+        return code - 0x30;
+      }
+      if (length == 8 && code >= 0xC0 && code <= 0xC7) {
+        return 280 + code - 0xC0;
+      }
+      if (length == 9 && code >= 0x190) {
+        return 144 + code - 0x190;
+      }
+    }
+    ADD_FAILURE() << "Invalid code " << code;
+    return 256;
+  };
+  static constexpr int lengthBase[] = {
+      3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static constexpr int lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                        1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                        4, 4, 4, 4, 5, 5, 5, 5, 0};
+  bool last = false;
+  while (!last) {
+    last = read(1);
+    const auto type = read(2);
+    if (type == 0) {
+      bit = (bit + 7) / 8 * 8;
+      const auto length = read(16);
+      EXPECT_EQ(read(16), ~length & 0xFFFF);
+      for (std::uint32_t i = 0; i < length; i++) {
+        out.push_back(read(8));
+      }
+      continue;
+    }
+    if (type != 1) {
+      ADD_FAILURE() << "Unexpected block type " << type;
+      break;
+    }
+    for (int symbol = readSymbol(); symbol != 256; symbol = readSymbol()) {
+      if (symbol < 256) {
+        out.push_back(symbol);
+        continue;
+      }
+      const int length = lengthBase[symbol - 257] + read(lengthExtra[symbol - 257]);
+      // The exporter only repeats the previous byte
+      std::uint32_t distance = 0;
+      for (int i = 0; i < 5; i++) {
+        distance = distance << 1 | read(1);
+      }
+      EXPECT_EQ(distance, 0u);
+      EXPECT_FALSE(out.empty());
+      for (int i = 0; i < length && !out.empty(); i++) {
+        out.push_back(out.back());
+      }
+    }
+  }
+  offset = (bit + 7) / 8;
+  return out;
+}
+
+TEST(FrameExporterTest, PngDecodesToThePixels){
+  const auto snapshot = exampleSnapshot();
+  FrameExporter exporter(70, 20, 3, FrameExporter::png, 4);
+  const auto image = exporter.encode(snapshot);
+  // Every chunk has the CRC of its type and data
+  std::vector<std::uint8_t> stream;
+  std::size_t offset = 8;
+  while (offset + 12 <= image.size()) {
+    const auto length = readUint32(image, offset);
+    ASSERT_LE(offset + 12 + length, image.size());
+    EXPECT_EQ(readUint32(image, offset + 8 + length),
+              crc32(image.data() + offset + 4, length + 4));
+    if (std::string(image.begin() + offset + 4, image.begin() + offset + 8) ==
+        "IDAT") {
+      stream.insert(stream.end(), image.begin() + offset + 8,
+                    image.begin() + offset + 8 + length);
+    }
+    offset += 12 + length;
+  }
+  // The zlib header, the deflate blocks and the Adler-32 of the rows
+  ASSERT_GE(stream.size(), 6u);
+  EXPECT_EQ((stream[0] << 8 | stream[1]) % 31, 0);
+  EXPECT_EQ(stream[0] & 0x0F, 8);
+  std::size_t position = 2;
+  const auto rows = inflate(stream, position);
+  ASSERT_EQ(position + 4, stream.size());
+  std::uint32_t a = 1;
+  std::uint32_t b = 0;
+  for (auto byte : rows) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  EXPECT_EQ(static_cast<std::uint32_t>(stream[position] << 24 |
+                                       stream[position + 1] << 16 |
+                                       stream[position + 2] << 8 |
+                                       stream[position + 3]),
+            b << 16 | a);
+  // Undoing the filters gives the pixels of the PPM image
+  const std::size_t rowBytes = 210 * 3;
+  ASSERT_EQ(rows.size(), 60 * (rowBytes + 1));
+  std::vector<std::uint8_t> pixels(60 * rowBytes);
+  for (std::size_t y = 0; y < 60; y++) {
+    const auto *row = rows.data() + y * (rowBytes + 1);
+    auto *pixel = pixels.data() + y * rowBytes;
+    for (std::size_t i = 0; i < rowBytes; i++) {
+      const std::uint8_t left = i >= 3 ? pixel[i - 3] : 0;
+      const std::uint8_t up = y > 0 ? pixel[i - rowBytes] : 0;
+      switch (row[0]) {
+      case 0: pixel[i] = row[1 + i]; break;
+      case 1: pixel[i] = row[1 + i] + left; break;
+      case 2: pixel[i] = row[1 + i] + up; break;
+      default: FAIL() << "Unexpected filter " << int(row[0]) << " on row " << y;
+      }
+    }
+  }
+  FrameExporter ppm(70, 20, 3, FrameExporter::ppm, 1);
+  const auto &reference = ppm.encode(snapshot);
+  const std::size_t header = std::string("P6\n210 60\n255\n").size();
+  ASSERT_EQ(reference.size(), header + pixels.size());
+  EXPECT_EQ(std::memcmp(reference.data() + header, pixels.data(),
+                        pixels.size()),
+            0);
+}
+
+TEST(FrameExporterTest, RejectsScaleBelowOne){
+  EXPECT_THROW(FrameExporter(70, 20, 0, FrameExporter::ppm),
+               std::runtime_error);
+  EXPECT_THROW(FrameExporter(70, 20, -3, FrameExporter::png),
+               std::runtime_error);
+}
@@ -1,7 +1,14 @@
 //GTest tests for game logic
 #include"server/game_logic.h"
+#include"server/input_queue.h"
+#include"server/send_queue.h"
+#include"server/state_encoder.h"
+#include"tile_codec.h"
+#include<array>
+#include<cstring>
 #include"gtest/gtest.h"
 #include<fstream>
+#include<set>
 using cycles::Id;
 using namespace cycles_server;
 // Game Logic
@@ -65,18 +72,19 @@ maxClients: 60
   return temp_file;
 }
 
-bool test_grid(std::vector<sf::Uint8> grid, std::map<Id, Player> players, Configuration conf) {
+bool test_grid(const cycles::TiledGrid &grid, const PlayerTable &players, Configuration conf) {
   int GRID_HEIGHT = conf.gridHeight;
   int GRID_WIDTH = conf.gridWidth;
-  std::vector<sf::Uint8> true_grid(GRID_HEIGHT * GRID_WIDTH, 0);
-  for (auto &[id, player] : players) {
+  std::vector<Id> true_grid(GRID_HEIGHT * GRID_WIDTH, 0);
+  for (auto &player : players) {
+    auto id = player.id;
     true_grid[player.position.y * GRID_WIDTH + player.position.x] = id;
     for (auto tail : player.tail) {
       true_grid[tail.y * GRID_WIDTH + tail.x] = id;
     }
   }
   for (int i = 0; i < GRID_HEIGHT * GRID_WIDTH; i++) {
-    if (grid[i] != true_grid[i]) {
+    if (grid.get(i % GRID_WIDTH, i / GRID_WIDTH) != true_grid[i]) {
       return false;
     }
   }
@@ -155,3 +163,463 @@ TEST(GameLogicTest, Grid){
   auto players = game.getPlayers();
   EXPECT_TRUE(test_grid(grid, players, conf));
 }
+
+TEST(GameLogicTest, Tail){
+  Tail tail;
+  tail.reserve(4);
+  for (int i = 0; i < 10; i++) {
+    tail.push_front(sf::Vector2i(i, 0));
+    if (tail.size() > 3) {
+      tail.pop_back();
+    }
+  }
+  EXPECT_EQ(tail.size(), 3);
+  EXPECT_EQ(tail.capacity(), 4);
+  EXPECT_EQ(tail.front(), sf::Vector2i(9, 0));
+  EXPECT_EQ(tail.back(), sf::Vector2i(7, 0));
+  // Growing keeps the order from front to back
+  tail.reserve(16);
+  int expected = 9;
+  for (auto cell : tail) {
+    EXPECT_EQ(cell, sf::Vector2i(expected--, 0));
+  }
+  EXPECT_EQ(expected, 6);
+}
+
+TEST(GameLogicTest, PlayerTable){
+  PlayerTable players;
+  for (Id id : {5, 2, 9}) {
+    Player player;
+    player.id = id;
+    player.name = "player" + std::to_string(id);
+    players.insert(player);
+  }
+  players.erase(5);
+  EXPECT_EQ(players.size(), 2);
+  EXPECT_FALSE(players.contains(5));
+  EXPECT_EQ(players.find(5), nullptr);
+  EXPECT_EQ(players.at(9).name, "player9");
+  std::vector<Id> ids;
+  for (const auto &player : players) {
+    ids.push_back(player.id);
+  }
+  EXPECT_EQ(ids, std::vector<Id>({2, 9}));
+}
+
+TEST(GameLogicTest, Snapshot){
+  std::string conf_file = writeConfig();
+  Configuration conf(conf_file);
+  Game game(conf);
+  EXPECT_EQ(game.getSnapshot().players.size(), 0);
+  Id id = game.addPlayer("player1");
+  Id id2 = game.addPlayer("player2");
+  game.setFrame(3);
+  game.movePlayers({{id, Direction::north}, {id2, Direction::south}});
+  game.publishSnapshot();
+  const auto &snapshot = game.getSnapshot();
+  EXPECT_EQ(snapshot.frame, 3);
+  EXPECT_EQ(snapshot.grid, game.getGrid());
+  ASSERT_EQ(snapshot.players.size(), game.getPlayers().size());
+  for (const auto &view : snapshot.players) {
+    const auto &player = game.getPlayers().at(view.id);
+    EXPECT_EQ(view.position, player.position);
+    auto tail = snapshot.getTail(view);
+    EXPECT_TRUE(std::equal(tail.begin(), tail.end(), player.tail.begin(),
+                           player.tail.end()));
+  }
+  // Reading again without a new publish returns the same snapshot
+  EXPECT_EQ(game.getSnapshot().sequence, snapshot.sequence);
+}
+
+TEST(GameLogicTest, SnapshotTileVersions){
+  std::string conf_file = writeConfig();
+  Configuration conf(conf_file);
+  conf.gridWidth = 200;
+  conf.gridHeight = 200;
+  conf.seed = 3;
+  Game game(conf);
+  const auto versions = game.getSnapshot().tileVersions;
+  // 4x4 tiles, the ones on the right and bottom edges partly out of the grid
+  ASSERT_EQ(versions.size(), 16);
+  Id id = game.addPlayer("player1");
+  game.publishSnapshot();
+  auto tileOf = [](sf::Vector2i position) {
+    constexpr int tileSize = cycles::TiledGrid::tileSize;
+    return position.y / tileSize * 4 + position.x / tileSize;
+  };
+  const auto start = game.getPlayers().at(id).position;
+  const auto &snapshot = game.getSnapshot();
+  for (int index = 0; index < 16; ++index) {
+    // Only the tile the player spawned in changed
+    EXPECT_EQ(snapshot.tileVersions[index] != versions[index],
+              index == tileOf(start));
+  }
+  const auto spawned = snapshot.tileVersions;
+  game.publishSnapshot();
+  EXPECT_EQ(game.getSnapshot().tileVersions, spawned);
+  game.movePlayers({{id, Direction::east}});
+  game.publishSnapshot();
+  const auto &moved = game.getSnapshot().tileVersions;
+  EXPECT_NE(moved[tileOf(game.getPlayers().at(id).position)],
+            spawned[tileOf(game.getPlayers().at(id).position)]);
+}
+
+TEST(GameLogicTest, Collisions){
+  std::string conf_file = writeConfig();
+  Configuration conf(conf_file);
+  Game game(conf);
+  for (int i = 0; i < 200; i++) {
+    game.addPlayer("player" + std::to_string(i));
+  }
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> dist(0, 3);
+  for (int frame = 0; frame < 100 && game.getPlayers().size() > 0; frame++) {
+    std::map<Id, Direction> directions;
+    std::map<Id, sf::Vector2i> targets;
+    for (const auto &player : game.getPlayers()) {
+      directions[player.id] = cycles::getDirectionFromValue(dist(rng));
+      targets[player.id] =
+          player.position + cycles::getDirectionVector(directions[player.id]);
+    }
+    // Reference: out of the grid, into an occupied cell or into the same cell
+    // as another player
+    std::set<Id> expectedDead;
+    const auto &grid = game.getGrid();
+    for (const auto &[id, pos] : targets) {
+      if (pos.x < 0 || pos.x >= conf.gridWidth || pos.y < 0 ||
+          pos.y >= conf.gridHeight || grid.get(pos.x, pos.y)) {
+        expectedDead.insert(id);
+      }
+      for (const auto &[id2, pos2] : targets) {
+        if (id != id2 && pos == pos2) {
+          expectedDead.insert(id);
+        }
+      }
+    }
+    game.setFrame(frame);
+    game.movePlayers(directions);
+    for (const auto &[id, pos] : targets) {
+      EXPECT_EQ(game.getPlayers().contains(id), !expectedDead.contains(id));
+    }
+    EXPECT_TRUE(test_grid(game.getGrid(), game.getPlayers(), conf));
+  }
+}
+
+TEST(GameLogicTest, FullGrid){
+  Configuration conf;
+  conf.gridWidth = 5;
+  conf.gridHeight = 3;
+  Game game(conf);
+  for (int i = 0; i < 15; i++) {
+    EXPECT_NE(game.addPlayer("player" + std::to_string(i)), 0);
+  }
+  EXPECT_EQ(game.getOccupiedCells(), 15);
+  EXPECT_FLOAT_EQ(game.getFillRatio(), 1.0f);
+  EXPECT_EQ(game.addPlayer("too many"), 0);
+  EXPECT_EQ(game.getPlayers().size(), 15);
+  game.removePlayer(3);
+  EXPECT_EQ(game.getOccupiedCells(), 14);
+  EXPECT_NE(game.addPlayer("last one"), 0);
+}
+
+TEST(GameLogicTest, FreeCells){
+  const int cells = 10000;
+  FreeCells freeCells(cells);
+  std::vector<bool> occupied(cells, false);
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> dist(0, cells - 1);
+  for (int i = 0; i < 20000; i++) {
+    int cell = dist(rng);
+    occupied[cell] = !occupied[cell];
+    freeCells.set(cell, occupied[cell]);
+  }
+  std::vector<int> expected;
+  for (int cell = 0; cell < cells; cell++) {
+    if (!occupied[cell]) {
+      expected.push_back(cell);
+    }
+  }
+  ASSERT_EQ(freeCells.getFreeCount(), expected.size());
+  for (int n = 0; n < static_cast<int>(expected.size()); n++) {
+    ASSERT_EQ(freeCells.nthFree(n), expected[n]);
+  }
+}
+
+TEST(GameLogicTest, DeltaStates){
+  Configuration conf;
+  conf.gridWidth = 200;
+  conf.gridHeight = 200;
+  Game game(conf);
+  game.trackChanges();
+  Id id = game.addPlayer("player1");
+  Id id2 = game.addPlayer("player2");
+  StateEncoder encoder;
+  encoder.encode(game, 0, StateEncoder::keyframe);
+  using cycles::protocol::FrameView;
+  auto view = [](const sf::Packet &packet) {
+    return FrameView(packet.getData(), packet.getDataSize(),
+                     cycles::TiledGrid::tileSize);
+  };
+  auto keyframe = view(encoder.keyframeState);
+  ASSERT_TRUE(keyframe.isValid());
+  EXPECT_EQ(keyframe.header().kind, cycles::protocol::keyframe);
+  EXPECT_EQ(keyframe.header().playerCount, 2);
+  EXPECT_EQ(keyframe.name(keyframe.player(1)), "player2");
+  EXPECT_EQ(keyframe.header().tileCount, game.getGrid().getTileCount());
+  for (int frame = 1; frame < 4; frame++) {
+    game.movePlayers({{id, Direction::north}, {id2, Direction::south}});
+    encoder.encode(game, frame, StateEncoder::delta);
+    auto delta = view(encoder.deltaState);
+    ASSERT_TRUE(delta.isValid());
+    EXPECT_EQ(delta.header().kind, cycles::protocol::delta);
+    EXPECT_EQ(delta.header().frame, frame);
+    ASSERT_EQ(delta.header().playerCount, 2);
+    for (std::uint32_t i = 0; i < 2; i++) {
+      auto record = delta.player(i);
+      EXPECT_FALSE(record.isNew);
+      EXPECT_EQ(game.getPlayers().at(record.id).position,
+                sf::Vector2i(record.x, record.y));
+    }
+    // Only the new heads, the trails are not long enough to shrink yet
+    ASSERT_EQ(delta.header().changeCount, 2);
+    EXPECT_EQ(delta.change(0).id, id);
+  }
+  // Removing a player clears its head and its trail
+  game.removePlayer(id2);
+  std::vector<CellChange> changes;
+  game.takeChanges(changes);
+  EXPECT_EQ(changes.size(), 4);
+  for (const auto &change : changes) {
+    EXPECT_EQ(change.id, 0);
+  }
+}
+
+// Whether the state rebuilt by a client matches the game, cell by cell
+bool sameState(const cycles::GameState &state, Game &game,
+               const Configuration &conf) {
+  if (state.gridWidth != conf.gridWidth || state.gridHeight != conf.gridHeight) {
+    return false;
+  }
+  for (int y = 0; y < conf.gridHeight; y++) {
+    for (int x = 0; x < conf.gridWidth; x++) {
+      const Id id = game.getGrid().get(x, y);
+      if (state.getGridCell({x, y}) != id ||
+          state.occupied.contains({x, y}) != (id != 0)) {
+        return false;
+      }
+    }
+  }
+  if (state.players.size() != game.getPlayers().size()) {
+    return false;
+  }
+  auto player = state.players.begin();
+  for (const auto &expected : game.getPlayers()) {
+    if (player->id != expected.id || player->name != expected.name ||
+        player->position != expected.position ||
+        player->color != expected.color) {
+      return false;
+    }
+    ++player;
+  }
+  return true;
+}
+
+TEST(GameLogicTest, ClientAppliesDeltas){
+  Configuration conf;
+  conf.gridWidth = 200;
+  conf.gridHeight = 200;
+  conf.seed = 5;
+  Game game(conf);
+  game.trackChanges();
+  // Every player runs around a square of 15 cells a side, away from the
+  // edges, long enough for its trail to be cut at its maximum length
+  std::map<Id, std::array<Direction, 4>> loops;
+  auto join = [&](const std::string &name) {
+    const Id id = game.addPlayer(name);
+    const auto position = game.getPlayers().at(id).position;
+    const auto vertical = position.y > 100 ? Direction::north : Direction::south;
+    const auto horizontal = position.x > 100 ? Direction::west : Direction::east;
+    auto opposite = [](Direction direction) {
+      return cycles::getDirectionFromValue(
+          (cycles::getDirectionValue(direction) + 2) % 4);
+    };
+    loops[id] = {vertical, horizontal, opposite(vertical), opposite(horizontal)};
+    return id;
+  };
+  for (int i = 0; i < 3; i++) {
+    join("player" + std::to_string(i));
+  }
+  StateEncoder encoder;
+  encoder.encode(game, 0, StateEncoder::keyframe);
+  using cycles::protocol::FrameView;
+  auto view = [](const sf::Packet &packet) {
+    return FrameView(packet.getData(), packet.getDataSize(),
+                     cycles::TiledGrid::tileSize);
+  };
+  cycles::GameState state;
+  state.applyKeyframe(view(encoder.keyframeState));
+  ASSERT_TRUE(sameState(state, game, conf));
+  std::vector<cycles::Player> scratch;
+  Id removed = 0;
+  for (int frame = 1; frame <= 90; frame++) {
+    if (frame == 10 || frame == 40) {
+      join("late" + std::to_string(frame));
+    }
+    if (frame == 30) {
+      removed = join("removed");
+    }
+    if (frame == 50) {
+      game.removePlayer(removed);
+    }
+    std::map<Id, Direction> directions;
+    for (const auto &player : game.getPlayers()) {
+      directions[player.id] = loops[player.id][frame / 15 % 4];
+    }
+    game.setFrame(frame);
+    game.movePlayers(directions);
+    encoder.encode(game, frame, StateEncoder::delta);
+    ASSERT_TRUE(state.applyDelta(view(encoder.deltaState), scratch));
+    EXPECT_EQ(state.frameNumber, frame);
+    ASSERT_TRUE(sameState(state, game, conf)) << "frame " << frame;
+  }
+  // A player that joined first is still running, so trails were cut
+  EXPECT_TRUE(game.getPlayers().contains(1) || game.getPlayers().contains(2) ||
+              game.getPlayers().contains(3));
+  // A skipped delta is refused
+  encoder.encode(game, 91, StateEncoder::delta);
+  encoder.encode(game, 92, StateEncoder::delta);
+  EXPECT_FALSE(state.applyDelta(view(encoder.deltaState), scratch));
+}
+
+TEST(GameLogicTest, CompressedKeyframes){
+  Configuration conf;
+  conf.gridWidth = 300;
+  conf.gridHeight = 300;
+  conf.seed = 3;
+  Game game(conf);
+  game.trackChanges();
+  for (int i = 0; i < 20; i++) {
+    game.addPlayer("player" + std::to_string(i));
+  }
+  for (int frame = 0; frame < 30; frame++) {
+    std::map<Id, Direction> directions;
+    for (const auto &player : game.getPlayers()) {
+      directions[player.id] = player.position.y > 150 ? Direction::north
+                                                      : Direction::south;
+    }
+    game.movePlayers(directions);
+  }
+  StateEncoder encoder;
+  encoder.encode(game, 30,
+                 StateEncoder::keyframe | StateEncoder::compressedKeyframe);
+  using cycles::protocol::FrameView;
+  const auto &raw = encoder.keyframeState;
+  const auto &compressed = encoder.compressedKeyframeState;
+  FrameView rawView(raw.getData(), raw.getDataSize(),
+                    cycles::TiledGrid::tileSize);
+  FrameView compressedView(compressed.getData(), compressed.getDataSize(),
+                           cycles::TiledGrid::tileSize);
+  ASSERT_TRUE(rawView.isValid());
+  ASSERT_TRUE(compressedView.isValid());
+  EXPECT_FALSE(rawView.isCompressed());
+  EXPECT_TRUE(compressedView.isCompressed());
+  EXPECT_LT(compressed.getDataSize() * 4, raw.getDataSize());
+  ASSERT_EQ(compressedView.header().tileCount, rawView.header().tileCount);
+  std::vector<Id> cells(cycles::TiledGrid::tileSize *
+                        cycles::TiledGrid::tileSize);
+  for (std::uint32_t i = 0; i < rawView.header().tileCount; i++) {
+    auto data = compressedView.tileData(i);
+    ASSERT_TRUE(cycles::decompressTile(data.data(), data.size(), cells.data()));
+    auto expected = rawView.tileData(i);
+    EXPECT_EQ(std::memcmp(cells.data(), expected.data(), expected.size()), 0);
+  }
+  // Clients rebuild the same state from either keyframe
+  cycles::GameState state;
+  state.applyKeyframe(compressedView);
+  EXPECT_EQ(state.frameNumber, 30);
+  EXPECT_TRUE(sameState(state, game, conf));
+  state.applyKeyframe(rawView);
+  EXPECT_TRUE(sameState(state, game, conf));
+}
+
+TEST(GameLogicTest, SendQueue){
+  sf::Packet packet;
+  packet << sf::Uint32(7) << sf::Uint8(1);
+  auto frame = makeWireFrame(packet);
+  // Big endian size of the packet, then its data
+  ASSERT_EQ(frame->size(), 4u + 5u);
+  EXPECT_EQ((*frame)[3], 5);
+  EXPECT_EQ(std::memcmp(frame->data() + 4, packet.getData(), 5), 0);
+
+  SendQueue queue(3);
+  EXPECT_TRUE(queue.empty());
+  for (int i = 0; i < 3; i++) {
+    queue.push(frame);
+  }
+  EXPECT_TRUE(queue.isFull());
+  // Nothing was written yet, so every frame queued is replaced
+  auto latest = makeWireFrame(sf::Packet());
+  queue.coalesce(latest);
+  EXPECT_EQ(queue.size(), 1u);
+  EXPECT_EQ(queue.getDropped(), 3);
+  EXPECT_FALSE(queue.isFull());
+}
+
+TEST(GameLogicTest, InputQueue){
+  InputQueue queue(3);
+  queue.push(4, Direction::north);
+  queue.push(5, Direction::east);
+  queue.push(7, Direction::south);
+  // The move for frame 4 arrived too late and is discarded
+  EXPECT_EQ(queue.take(5), Direction::east);
+  EXPECT_EQ(queue.take(6), std::nullopt);
+  EXPECT_EQ(queue.size(), 1u);
+  EXPECT_EQ(queue.take(7), Direction::south);
+  // The oldest moves are dropped when the queue is full
+  for (int frame = 8; frame < 12; frame++) {
+    queue.push(frame, Direction::west);
+  }
+  EXPECT_EQ(queue.size(), 3u);
+  EXPECT_EQ(queue.take(8), std::nullopt);
+  EXPECT_EQ(queue.take(9), Direction::west);
+}
+
+TEST(GameLogicTest, SilentPlayersKeepMoving){
+  Configuration conf;
+  conf.gridWidth = 100;
+  conf.gridHeight = 100;
+  conf.seed = 8;
+  Game game(conf);
+  PlayerInputs inputs;
+  const Id silent = game.addPlayer("silent");
+  const Id late = game.addPlayer("late");
+  std::map<Id, sf::Vector2i> starts;
+  std::map<Id, Direction> initial;
+  for (const auto &player : game.getPlayers()) {
+    starts[player.id] = player.position;
+    initial[player.id] =
+        initialDirection(player.position, conf.gridWidth, conf.gridHeight);
+    inputs.add(player.id, initial[player.id], true);
+  }
+  auto opposite = [](Direction direction) {
+    return cycles::getDirectionFromValue(
+        (cycles::getDirectionValue(direction) + 2) % 4);
+  };
+  for (int frame = 1; frame <= 10; frame++) {
+    // Every move of late answers a frame already played, turning back would
+    // run into its own trail
+    inputs.push(late, frame - 1, opposite(initial[late]));
+    game.setFrame(frame);
+    game.movePlayers(inputs.take(frame));
+  }
+  for (const Id id : {silent, late}) {
+    ASSERT_TRUE(game.getPlayers().contains(id));
+    EXPECT_EQ(game.getPlayers().at(id).position,
+              starts[id] + cycles::getDirectionVector(initial[id]) * 10);
+  }
+  // Moves for the current frame are applied
+  inputs.push(silent, 11, Direction::north);
+  EXPECT_EQ(inputs.take(11).at(silent), Direction::north);
+  inputs.remove(silent);
+  EXPECT_FALSE(inputs.take(12).contains(silent));
+}
@@ -0,0 +1,107 @@
+//GTest tests for deterministic games and replays
+#include"server/replay.h"
+#include"gtest/gtest.h"
+#include<cstdio>
+#include<random>
+using cycles::Id;
+using namespace cycles_server;
+
+Configuration seededConfig(unsigned int seed){
+  Configuration conf;
+  conf.gridWidth = 60;
+  conf.gridHeight = 40;
+  conf.seed = seed;
+  return conf;
+}
+
+struct FrameState {
+  cycles::TiledGrid grid;
+  std::vector<std::pair<Id, sf::Vector2i>> heads;
+};
+
+FrameState captureState(Game &game){
+  FrameState state{game.getGrid(), {}};
+  for (const auto &player : game.getPlayers()) {
+    state.heads.push_back({player.id, player.position});
+  }
+  return state;
+}
+
+// Plays a random match, returning the state right before the moves of every
+// frame
+std::vector<FrameState> playMatch(Game &game, int frames){
+  for (int i = 0; i < 8; i++) {
+    game.addPlayer("player" + std::to_string(i));
+  }
+  std::vector<FrameState> states;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> dist(0, 3);
+  for (int frame = 0; frame < frames; frame++) {
+    game.setFrame(frame);
+    if (frame == 7 && game.getPlayers().size() > 0) {
+      game.removePlayer(game.getPlayers().getIds().back());
+    }
+    // Random moves, avoiding walls and trails when possible so that players
+    // live long enough to grow their trails
+    std::map<Id, Direction> directions;
+    const auto &grid = game.getGrid();
+    for (const auto &player : game.getPlayers()) {
+      auto direction = cycles::getDirectionFromValue(dist(rng));
+      for (int attempt = 0; attempt < 8; attempt++) {
+        auto pos = player.position + cycles::getDirectionVector(direction);
+        if (pos.x >= 0 && pos.x < 60 && pos.y >= 0 && pos.y < 40 &&
+            grid.get(pos.x, pos.y) == 0) {
+          break;
+        }
+        direction = cycles::getDirectionFromValue(dist(rng));
+      }
+      directions[player.id] = direction;
+    }
+    states.push_back(captureState(game));
+    game.movePlayers(directions);
+  }
+  return states;
+}
+
+TEST(ReplayTest, SeedIsDeterministic) {
+  Game game1(seededConfig(1234));
+  Game game2(seededConfig(1234));
+  auto states1 = playMatch(game1, 50);
+  auto states2 = playMatch(game2, 50);
+  for (int frame = 0; frame < 50; frame++) {
+    EXPECT_EQ(states1[frame].grid, states2[frame].grid);
+  }
+}
+
+TEST(ReplayTest, RecordAndSeek) {
+  const auto path = std::string(std::tmpnam(nullptr));
+  const auto conf = seededConfig(99);
+  const int frames = 200;
+  std::vector<FrameState> states;
+  {
+    Game game(conf);
+    game.setRecorder(
+        std::make_shared<ReplayRecorder>(path, conf, game.getSeed(), 16));
+    states = playMatch(game, frames);
+  }
+  // Some of the keyframes must hold players with trails
+  EXPECT_GT(states[48].heads.size(), 1);
+  ReplayPlayer replay(path);
+  EXPECT_EQ(replay.getFrameCount(), frames);
+  // Sequential playback
+  for (int frame = 0; frame < frames; frame++) {
+    replay.seek(frame);
+    ASSERT_EQ(replay.getFrame(), frame);
+    auto state = captureState(replay.getGame());
+    EXPECT_EQ(state.grid, states[frame].grid) << "frame " << frame;
+    EXPECT_EQ(state.heads, states[frame].heads) << "frame " << frame;
+  }
+  // Random access, backwards and forwards
+  for (int frame : {150, 3, 77, 76, 199, 0, 64}) {
+    replay.seek(frame);
+    auto state = captureState(replay.getGame());
+    EXPECT_EQ(state.grid, states[frame].grid) << "frame " << frame;
+    EXPECT_EQ(state.heads, states[frame].heads) << "frame " << frame;
+  }
+  std::remove(path.c_str());
+}
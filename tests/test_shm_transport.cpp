@@ -0,0 +1,86 @@
+#include "shm_transport.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace cycles::shm;
+
+namespace {
+std::string segmentName() { return "/cycles_test_" + std::to_string(getpid()); }
+
+std::vector<char> makeFrame(std::size_t size, char value) {
+  return std::vector<char>(size, value);
+}
+} // namespace
+
+TEST(ShmTransportTest, FramesAreReadInOrder) {
+  auto server = Segment::create(segmentName(), 1, 4, 1024);
+  auto client = Segment::open(segmentName());
+  FrameReader reader(*client);
+  std::vector<char> buffer;
+  EXPECT_EQ(reader.read(buffer), FrameReader::empty);
+  // Enough frames to wrap around the ring a few times
+  for (int i = 0; i < 40; i++) {
+    const auto frame = makeFrame(100 + i, static_cast<char>(i));
+    writeFrame(*server, frame.data(), frame.size());
+    ASSERT_EQ(reader.read(buffer), FrameReader::frame);
+    EXPECT_EQ(buffer, frame);
+  }
+  EXPECT_EQ(reader.read(buffer), FrameReader::empty);
+  EXPECT_FALSE(reader.wait(sf::milliseconds(1)));
+}
+
+TEST(ShmTransportTest, LappedReadersLoseFrames) {
+  auto server = Segment::create(segmentName(), 1, 4, 1024);
+  FrameReader reader(*server);
+  std::vector<char> buffer;
+  for (int i = 0; i < 20; i++) {
+    const auto frame = makeFrame(200, static_cast<char>(i));
+    writeFrame(*server, frame.data(), frame.size());
+  }
+  EXPECT_EQ(reader.read(buffer), FrameReader::lost);
+  // Reading goes on with the frames written afterwards
+  EXPECT_EQ(reader.read(buffer), FrameReader::empty);
+  const auto frame = makeFrame(10, 'x');
+  writeFrame(*server, frame.data(), frame.size());
+  ASSERT_EQ(reader.read(buffer), FrameReader::frame);
+  EXPECT_EQ(buffer, frame);
+  const auto tooLarge = makeFrame(600, 'y');
+  EXPECT_THROW(writeFrame(*server, tooLarge.data(), tooLarge.size()),
+               std::runtime_error);
+}
+
+TEST(ShmTransportTest, WaitWakesUpOnNewFrames) {
+  auto server = Segment::create(segmentName(), 1, 4, 1024);
+  auto client = Segment::open(segmentName());
+  FrameReader reader(*client);
+  std::thread writer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    const auto frame = makeFrame(10, 'z');
+    writeFrame(*server, frame.data(), frame.size());
+  });
+  EXPECT_TRUE(reader.wait(sf::seconds(5)));
+  writer.join();
+  std::vector<char> buffer;
+  EXPECT_EQ(reader.read(buffer), FrameReader::frame);
+}
+
+TEST(ShmTransportTest, Moves) {
+  auto server = Segment::create(segmentName(), 1, 4, 1024);
+  auto client = Segment::open(segmentName());
+  std::uint32_t lastSequence = server->moveSlot(2).sequence.load();
+  Move move{};
+  EXPECT_FALSE(readMove(server->moveSlot(2), lastSequence, move));
+  writeMove(client->moveSlot(2), 7, 3);
+  writeMove(client->moveSlot(2), 8, 1);
+  // Only the latest move is kept
+  ASSERT_TRUE(readMove(server->moveSlot(2), lastSequence, move));
+  EXPECT_EQ(move.frame, 8);
+  EXPECT_EQ(move.direction, 1);
+  EXPECT_FALSE(readMove(server->moveSlot(2), lastSequence, move));
+}
+
+TEST(ShmTransportTest, OpenChecksTheSegment) {
+  EXPECT_THROW(Segment::open("/cycles_test_missing"), std::runtime_error);
+}
@@ -0,0 +1,31 @@
+//GTest tests for the in process simulation
+#include"sim/simulation.h"
+#include"gtest/gtest.h"
+using namespace cycles_sim;
+
+class NorthBot : public Bot {
+public:
+  std::vector<Id> seenIds;
+  Direction decideMove(const GameState &state, Id playerId) override {
+    seenIds.push_back(playerId);
+    EXPECT_EQ(state.grid.getWidth(), state.gridWidth);
+    EXPECT_EQ(state.grid.getHeight(), state.gridHeight);
+    return Direction::north;
+  }
+};
+
+TEST(SimulationTest, RunsUntilGameOver) {
+  cycles_server::Configuration conf("");
+  Simulation simulation(conf);
+  auto bot = std::make_unique<NorthBot>();
+  auto botPtr = bot.get();
+  Id id = simulation.addBot("north1", std::move(bot));
+  simulation.addBot("north2", std::make_unique<NorthBot>());
+  auto result = simulation.run(1000);
+  // Both bots drive into the top wall, the game ends before they get there
+  EXPECT_TRUE(simulation.getGame().isGameOver());
+  EXPECT_LE(result.frames, conf.gridHeight);
+  EXPECT_LE(result.survivors.size(), 1);
+  ASSERT_GT(botPtr->seenIds.size(), 0);
+  EXPECT_EQ(botPtr->seenIds.front(), id);
+}
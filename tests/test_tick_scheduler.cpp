@@ -0,0 +1,35 @@
+#include "server/tick_scheduler.h"
+#include <gtest/gtest.h>
+
+using namespace cycles_server;
+using namespace std::chrono;
+
+// The test process can be descheduled at any time, which looks like an
+// overrun to the scheduler, so only lower bounds on the time are checked
+
+TEST(TickSchedulerTest, SleepsUntilTheNextTick) {
+  TickScheduler scheduler(100);
+  const auto start = TickScheduler::Clock::now();
+  int skipped = 0;
+  for (int i = 0; i < 4; i++) {
+    skipped += scheduler.waitForTick();
+  }
+  // The first tick is due immediately, the others at least 10 ms apart
+  EXPECT_GE(TickScheduler::Clock::now() - start, milliseconds(30));
+  // Ticks are only skipped by overruns
+  EXPECT_EQ(skipped > 0, scheduler.getOverruns() > 0);
+}
+
+TEST(TickSchedulerTest, SkipsTheTicksOfAnOverrun) {
+  TickScheduler scheduler(100);
+  scheduler.waitForTick();
+  std::this_thread::sleep_for(milliseconds(45));
+  // The tick was due at least 35 ms ago, 3 whole ticks were missed
+  const auto overrun = TickScheduler::Clock::now();
+  EXPECT_GE(scheduler.waitForTick(), 3);
+  EXPECT_GE(scheduler.getOverruns(), 1);
+  // The schedule restarts after the overrun instead of catching up, so the
+  // next tick is a whole period away
+  scheduler.waitForTick();
+  EXPECT_GE(TickScheduler::Clock::now() - overrun, milliseconds(10));
+}
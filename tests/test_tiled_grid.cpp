@@ -0,0 +1,102 @@
+//GTest tests for the tiled grid
+#include"tiled_grid.h"
+#include"tile_codec.h"
+#include"gtest/gtest.h"
+#include<random>
+using cycles::Id;
+using cycles::TiledGrid;
+
+TEST(TiledGridTest, SetAndGet){
+  // Not a multiple of the tile size, the last tiles are partial
+  TiledGrid grid(130, 70);
+  std::vector<Id> reference(130 * 70, 0);
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> cell(0, 130 * 70 - 1);
+  std::uniform_int_distribution<int> value(0, 5);
+  for (int i = 0; i < 5000; i++) {
+    int c = cell(rng);
+    Id id = value(rng);
+    grid.set(c % 130, c / 130, id);
+    reference[c] = id;
+  }
+  for (int c = 0; c < 130 * 70; c++) {
+    ASSERT_EQ(grid.get(c % 130, c / 130), reference[c]);
+  }
+  int visited = 0;
+  grid.forEachCell([&](sf::Vector2i position, Id id) {
+    EXPECT_EQ(reference[position.y * 130 + position.x], id);
+    EXPECT_NE(id, 0);
+    visited++;
+  });
+  EXPECT_EQ(visited, std::count_if(reference.begin(), reference.end(),
+                                   [](Id id) { return id != 0; }));
+}
+
+TEST(TiledGridTest, EmptyTilesAreReleased){
+  TiledGrid grid(4096, 4096);
+  EXPECT_EQ(grid.getTileCount(), 0);
+  grid.set(0, 0, 1);
+  grid.set(63, 63, 1);
+  grid.set(4095, 4095, 2);
+  EXPECT_EQ(grid.getTileCount(), 2);
+  grid.set(0, 0, 0);
+  EXPECT_EQ(grid.getTileCount(), 2);
+  grid.set(63, 63, 0);
+  EXPECT_EQ(grid.getTileCount(), 1);
+  EXPECT_EQ(grid.get(63, 63), 0);
+  EXPECT_EQ(grid.get(4095, 4095), 2);
+  EXPECT_EQ(grid.getTile(0), nullptr);
+  const auto *last = grid.getTile(64 * 64 - 1);
+  ASSERT_NE(last, nullptr);
+  EXPECT_EQ(last->cells.back(), 2);
+  // Clearing a cell of a missing tile does not allocate it
+  grid.set(100, 100, 0);
+  EXPECT_EQ(grid.getTileCount(), 1);
+}
+
+TEST(TiledGridTest, CopyAndPacket){
+  TiledGrid grid(300, 200);
+  for (int i = 0; i < 300; i += 7) {
+    grid.set(i, i % 200, i % 250 + 1);
+  }
+  TiledGrid copy(300, 200);
+  copy.set(299, 0, 3); // Replaced by the assignment
+  copy = grid;
+  EXPECT_EQ(copy, grid);
+  EXPECT_EQ(copy.get(299, 0), 0);
+  sf::Packet packet;
+  packet << grid;
+  TiledGrid received(300, 200);
+  packet >> received;
+  EXPECT_EQ(received, grid);
+  EXPECT_TRUE(packet.endOfPacket());
+  grid.set(1, 0, 9);
+  EXPECT_FALSE(received == grid);
+}
+
+TEST(TiledGridTest, TileCodec){
+  TiledGrid grid(TiledGrid::tileSize, TiledGrid::tileSize);
+  // A straight trail, a full row and scattered cells
+  for (int y = 3; y < 50; y++) {
+    grid.set(10, y, 4);
+  }
+  for (int x = 0; x < TiledGrid::tileSize; x++) {
+    grid.set(x, 63, 7);
+  }
+  std::mt19937 rng(3);
+  for (int i = 0; i < 100; i++) {
+    grid.set(rng() % 64, rng() % 64, rng() % 200 + 1);
+  }
+  grid.forEachTile([](sf::Vector2i, const TiledGrid::Tile &tile) {
+    std::vector<char> compressed;
+    cycles::compressTile(tile, compressed);
+    EXPECT_LT(compressed.size(), sizeof(tile.cells) / 4);
+    std::vector<Id> cells(tile.cells.size());
+    ASSERT_TRUE(cycles::decompressTile(compressed.data(), compressed.size(),
+                                       cells.data()));
+    EXPECT_TRUE(std::equal(cells.begin(), cells.end(), tile.cells.begin()));
+    // Truncated data is rejected
+    EXPECT_FALSE(cycles::decompressTile(compressed.data(),
+                                        compressed.size() - 1, cells.data()));
+  });
+}